@@ -0,0 +1,997 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "translators/disk_bitmap.h"
+#include "translators/bitmap_pointslist.h"
+#include "translators/shortcycle.h"
+#include "translators/pointslist_doubleslist.h"
+#include "translators/doubleslist_fourier.h"
+#include "translators/doubleslist_bitmap.h"
+#include "translators/homothetie.h"
+#include "types/fbase.h"
+#include "types/probe.h"
+
+#define MAX_SIZES 16
+
+#define SHAPE_CIRCLES 0
+#define SHAPE_SPIRAL 1
+#define SHAPE_WALK 2
+#define SHAPE_GLYPHS 3
+#define SHAPES 4
+
+static const char *shape_names[SHAPES] = {
+    "circles",
+    "spiral",
+    "walk",
+    "glyphs",
+};
+
+struct args_state {
+    uint32_t sizes[MAX_SIZES];
+    size_t sizes_num;
+    unsigned int shapes;
+    size_t density;
+    size_t modes;
+    size_t warmup;
+    size_t repetitions;
+    size_t complete_limit;
+    const char *work;
+    const char *mini_fourier;
+    unsigned int density_set:1;
+    unsigned int modes_set:1;
+    unsigned int warmup_set:1;
+    unsigned int repetitions_set:1;
+    unsigned int complete_limit_set:1;
+    unsigned int help_set:1;
+};
+
+static int parse_sizes(const char *arg, struct args_state *state) {
+    if (state->sizes_num > 0) {
+        dprintf(2, "Sizes are already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (sizes)\n");
+        return -1;
+    }
+    const char *p = arg;
+    while (1) {
+        char *end = NULL;
+        unsigned long long size = strtoull(p, &end, 0);
+        if ((end == p) || ((*end != ',') && (*end != '\0')) || (size < 16) || (size > 16384) || (state->sizes_num == MAX_SIZES)) {
+            dprintf(2, "Cannot parse sizes (up to %d sizes from 16 to 16384, separated by commas)\n", MAX_SIZES);
+            return -1;
+        }
+        state->sizes[state->sizes_num] = size;
+        ++state->sizes_num;
+        if (*end == '\0') {
+            break;
+        }
+        p = end + 1;
+    }
+    return 0;
+}
+
+static int parse_shapes(const char *arg, struct args_state *state) {
+    if (state->shapes != 0) {
+        dprintf(2, "Shapes are already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (shapes)\n");
+        return -1;
+    }
+    const char *p = arg;
+    while (1) {
+        size_t len = strcspn(p, ",");
+        int s = 0;
+        while ((s < SHAPES) && ((strlen(shape_names[s]) != len) || (strncmp(p, shape_names[s], len) != 0))) {
+            ++s;
+        }
+        if (s == SHAPES) {
+            dprintf(2, "Provided shape is not supported (try \"circles\", \"spiral\", \"walk\" or \"glyphs\")\n");
+            return -1;
+        }
+        state->shapes |= 1u << s;
+        if (p[len] == '\0') {
+            break;
+        }
+        p += len + 1;
+    }
+    return 0;
+}
+
+static int parse_count(const char *arg, size_t *count, const char *name) {
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (%s)\n", name);
+        return -1;
+    }
+    char *end = NULL;
+    *count = strtoull(arg, &end, 0);
+    if ((end == arg) || (*end != '\0')) {
+        dprintf(2, "Cannot parse %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_density(const char *arg, struct args_state *state) {
+    if (state->density_set) {
+        dprintf(2, "Density is already set\n");
+        return -1;
+    }
+    state->density_set = 1;
+    return parse_count(arg, &state->density, "density");
+}
+
+static int parse_modes(const char *arg, struct args_state *state) {
+    if (state->modes_set) {
+        dprintf(2, "Number of modes is already set\n");
+        return -1;
+    }
+    state->modes_set = 1;
+    return parse_count(arg, &state->modes, "modes");
+}
+
+static int parse_warmup(const char *arg, struct args_state *state) {
+    if (state->warmup_set) {
+        dprintf(2, "Warm-up is already set\n");
+        return -1;
+    }
+    state->warmup_set = 1;
+    return parse_count(arg, &state->warmup, "warmup");
+}
+
+static int parse_repetitions(const char *arg, struct args_state *state) {
+    if (state->repetitions_set) {
+        dprintf(2, "Number of repetitions is already set\n");
+        return -1;
+    }
+    state->repetitions_set = 1;
+    return parse_count(arg, &state->repetitions, "repetitions");
+}
+
+static int parse_complete_limit(const char *arg, struct args_state *state) {
+    if (state->complete_limit_set) {
+        dprintf(2, "Complete cycle limit is already set\n");
+        return -1;
+    }
+    state->complete_limit_set = 1;
+    return parse_count(arg, &state->complete_limit, "complete_limit");
+}
+
+static int parse_work(const char *arg, struct args_state *state) {
+    if (state->work != NULL) {
+        dprintf(2, "Work directory is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (work)\n");
+        return -1;
+    }
+    state->work = arg;
+    return 0;
+}
+
+static int parse_mini_fourier(const char *arg, struct args_state *state) {
+    if (state->mini_fourier != NULL) {
+        dprintf(2, "mini_fourier is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (mini_fourier)\n");
+        return -1;
+    }
+    state->mini_fourier = arg;
+    return 0;
+}
+
+static int parse_help(const char *arg, struct args_state *state) {
+    if (state->help_set) {
+        dprintf(2, "Help is already set\n");
+        return -1;
+    }
+    if (arg != NULL) {
+        dprintf(2, "Unexpected parameter (help)\n");
+        return -1;
+    }
+    state->help_set = 1;
+    return 0;
+}
+
+struct option {
+    const char *arg_name;
+    const char *parameter_name;
+    const char *description;
+    const char *deflt;
+    int (*parse)(const char *arg, struct args_state *state);
+};
+
+static struct option options[] = {
+    {
+        .arg_name = "sizes",
+        .parameter_name = "list",
+        .description = "<list> is the comma separated widths (and heights) of the generated pictures",
+        .parse = parse_sizes,
+        .deflt = "128,256,512,1024",
+    },
+    {
+        .arg_name = "shapes",
+        .parameter_name = "list",
+        .description = "<list> is a comma separated list of \"circles\" (concentric circles), \"spiral\" (Archimedean spiral), \"walk\" (random-walk strokes) or \"glyphs\" (lines of letter-like strokes)",
+        .parse = parse_shapes,
+        .deflt = "circles,spiral,walk,glyphs",
+    },
+    {
+        .arg_name = "density",
+        .parameter_name = "d",
+        .description = "<d> sets the number of points of each picture, d times its size",
+        .parse = parse_density,
+        .deflt = "4",
+    },
+    {
+        .arg_name = "modes",
+        .parameter_name = "modes",
+        .description = "<modes> is the number of modes analysed and rebuilt",
+        .parse = parse_modes,
+        .deflt = "200",
+    },
+    {
+        .arg_name = "warmup",
+        .parameter_name = "n",
+        .description = "<n> is the number of runs of each stage left out of the figures",
+        .parse = parse_warmup,
+        .deflt = "1",
+    },
+    {
+        .arg_name = "repetitions",
+        .parameter_name = "n",
+        .description = "<n> is the number of measured runs of each stage",
+        .parse = parse_repetitions,
+        .deflt = "5",
+    },
+    {
+        .arg_name = "complete_limit",
+        .parameter_name = "points",
+        .description = "<points> is the largest picture given to short_cycle, whose memory is quadratic on the points (sparse_short_cycle is run on all of them)",
+        .parse = parse_complete_limit,
+        .deflt = "4096",
+    },
+    {
+        .arg_name = "work",
+        .parameter_name = "directory",
+        .description = "<directory> receives the generated pictures and the files written by the stages",
+        .parse = parse_work,
+        .deflt = "build/bench",
+    },
+    {
+        .arg_name = "mini_fourier",
+        .parameter_name = "path",
+        .description = "<path> is the program run for the whole flow, which is skipped if it cannot be run",
+        .parse = parse_mini_fourier,
+        .deflt = "bin/mini_fourier",
+    },
+    {
+        .arg_name = "help",
+        .parameter_name = NULL,
+        .description = "Prints this help",
+        .parse = parse_help,
+        .deflt = NULL,
+    },
+    { 0 }
+};
+
+
+static void show_help(const char *cmd) {
+    dprintf(2, "%s ", cmd);
+    struct option *opt;
+    opt = options;
+    while (opt->arg_name != NULL) {
+        _Bool mandatory = (opt->parameter_name != NULL) && (opt->deflt == NULL);
+        if (!mandatory) {
+            dprintf(2, "[");
+        }
+        dprintf(2, "--%s", opt->arg_name);
+        if (opt->parameter_name != NULL) {
+            dprintf(2, " <%s>", opt->parameter_name);
+        }
+        if (!mandatory) {
+            dprintf(2, "]");
+        }
+        dprintf(2, " ");
+        ++opt;
+    }
+    dprintf(2, "\n");
+    opt = options;
+    while (opt->arg_name != NULL) {
+        dprintf(2, "  --%s", opt->arg_name);
+        if (opt->parameter_name != NULL) {
+            dprintf(2, " <%s>", opt->parameter_name);
+        }
+        dprintf(2, ": %s", opt->description);
+        if (opt->deflt != NULL) {
+            dprintf(2, " (deflt is \"%s\")", opt->deflt);
+        }
+        dprintf(2, "\n");
+        ++opt;
+    }
+    return;
+}
+
+static int parse_args(struct args_state *args, int argc, char **argv) {
+    int i = 1;
+    while (i < argc) {
+        if ((argv[i][0] == '\0') || (argv[i][1] == '\0')) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        if ((argv[i][0] != '-') || (argv[i][1] != '-')) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        struct option *opt = options;
+        while (opt->arg_name != NULL) {
+            if (strcmp(argv[i] + 2, opt->arg_name) == 0) {
+                break;
+            }
+            ++opt;
+        }
+        if (opt->arg_name == NULL) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        const char *param = NULL;
+        if (opt->parameter_name != NULL) {
+            ++i;
+            if (i >= argc) {
+                dprintf(2, "%s: missing parameter\n", argv[i-1]);
+                return -1;
+            }
+            param = argv[i];
+        }
+        int r = opt->parse(param, args);
+        if (r != 0) {
+            return -1;
+        }
+        ++i;
+    }
+    return 0;
+}
+
+static int set_deflts(struct args_state *args) {
+    if (args->sizes_num == 0) {
+        static const uint32_t sizes[] = { 128, 256, 512, 1024 };
+        memcpy(args->sizes, sizes, sizeof(sizes));
+        args->sizes_num = sizeof(sizes) / sizeof(*sizes);
+    }
+    if (args->shapes == 0) {
+        args->shapes = (1u << SHAPES) - 1;
+    }
+    if (args->density_set == 0) {
+        args->density = 4;
+        args->density_set = 1;
+    }
+    if (args->modes_set == 0) {
+        args->modes = 200;
+        args->modes_set = 1;
+    }
+    if (args->warmup_set == 0) {
+        args->warmup = 1;
+        args->warmup_set = 1;
+    }
+    if (args->repetitions_set == 0) {
+        args->repetitions = 5;
+        args->repetitions_set = 1;
+    }
+    if (args->complete_limit_set == 0) {
+        args->complete_limit = 4096;
+        args->complete_limit_set = 1;
+    }
+    if (args->work == NULL) {
+        args->work = "build/bench";
+    }
+    if (args->mini_fourier == NULL) {
+        args->mini_fourier = "bin/mini_fourier";
+    }
+    return 0;
+}
+
+/*
+ * Generators: 1 bit pictures of size x size pixels whose strokes are 1 pixel
+ * wide, drawn until budget points are set. The shapes are spaced from the
+ * budget, so that they are drawn almost whole.
+ */
+struct canvas {
+    struct raw_bitmap *bm;
+    long size;
+    size_t points;
+    size_t budget;
+    uint64_t seed;
+};
+
+static uint64_t next_random(struct canvas *c) {
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 7;
+    c->seed ^= c->seed << 17;
+    return c->seed;
+}
+
+static double uniform(struct canvas *c) {
+    return (double)(next_random(c) >> 11) / (double)(UINT64_C(1) << 53);
+}
+
+static void plot(struct canvas *c, long x, long y) {
+    uint32_t color = 1;
+    if ((x < 0) || (y < 0) || (x >= c->size) || (y >= c->size) || (c->points >= c->budget)) {
+        return;
+    }
+    (void)get_pixel(c->bm, x, y, &color);
+    if (color == 0) {
+        (void)set_pixel(c->bm, x, y, 1);
+        ++c->points;
+    }
+    return;
+}
+
+static void segment(struct canvas *c, double fx0, double fy0, double fx1, double fy1) {
+    long x0 = lround(fx0);
+    long y0 = lround(fy0);
+    long x1 = lround(fx1);
+    long y1 = lround(fy1);
+    long dx = labs(x1 - x0);
+    long dy = -labs(y1 - y0);
+    long sx = (x0 < x1) ? 1 : -1;
+    long sy = (y0 < y1) ? 1 : -1;
+    long err = dx + dy;
+    while (1) {
+        plot(c, x0, y0);
+        if ((x0 == x1) && (y0 == y1)) {
+            break;
+        }
+        long e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+    return;
+}
+
+/* Gap between the turns of circles and spirals whose length is about the budget */
+static double turn_gap(const struct canvas *c) {
+    double radius = 0.5 * (double)c->size - 2.0;
+    double gap = M_PI * radius * radius / (double)c->budget;
+    return (gap < 3.0) ? 3.0 : gap;
+}
+
+static void draw_circles(struct canvas *c) {
+    double center = 0.5 * (double)(c->size - 1);
+    double gap = turn_gap(c);
+    for (double r = 0.5 * (double)c->size - 2.0; (r >= 1.0) && (c->points < c->budget); r -= gap) {
+        size_t sides = 8 + (size_t)(2.0 * M_PI * r / 2.0);
+        for (size_t i = 0; i < sides; ++i) {
+            double a0 = 2.0 * M_PI * (double)i / (double)sides;
+            double a1 = 2.0 * M_PI * (double)(i + 1) / (double)sides;
+            segment(c, center + r * cos(a0), center + r * sin(a0), center + r * cos(a1), center + r * sin(a1));
+        }
+    }
+    return;
+}
+
+static void draw_spiral(struct canvas *c) {
+    double center = 0.5 * (double)(c->size - 1);
+    double gap = turn_gap(c);
+    double limit = 0.5 * (double)c->size - 2.0;
+    double x = center;
+    double y = center;
+    double a = 0.0;
+    while (c->points < c->budget) {
+        double r = gap * a / (2.0 * M_PI);
+        if (r > limit) {
+            break;
+        }
+        /* Steps of about 2 pixels along the curve */
+        a += 2.0 / ((r > 1.0) ? r : 1.0);
+        r = gap * a / (2.0 * M_PI);
+        double nx = center + r * cos(a);
+        double ny = center + r * sin(a);
+        segment(c, x, y, nx, ny);
+        x = nx;
+        y = ny;
+    }
+    return;
+}
+
+static void draw_walk(struct canvas *c) {
+    while (c->points < c->budget) {
+        double x = 2.0 + uniform(c) * (double)(c->size - 4);
+        double y = 2.0 + uniform(c) * (double)(c->size - 4);
+        double heading = 2.0 * M_PI * uniform(c);
+        size_t steps = 10 + next_random(c) % 90;
+        for (size_t i = 0; (i < steps) && (c->points < c->budget); ++i) {
+            heading += 0.6 * (uniform(c) - 0.5);
+            double nx = x + 2.0 * cos(heading);
+            double ny = y + 2.0 * sin(heading);
+            if ((nx < 1.0) || (ny < 1.0) || (nx > (double)(c->size - 2)) || (ny > (double)(c->size - 2))) {
+                break;
+            }
+            segment(c, x, y, nx, ny);
+            x = nx;
+            y = ny;
+        }
+    }
+    return;
+}
+
+/* Letter-like strokes on a 3 x 5 grid, as digit pairs (column, row), polylines being separated by '|' */
+static const char *glyphs[] = {
+    "0401102124|0222",
+    "20000424|0212",
+    "000424",
+    "04002420",
+    "0020242000",
+    "200002222404",
+    "0020|1014",
+    "001420",
+    "0024|2004",
+    "00200424",
+    "0004|0222|2024",
+    "04001224|2024",
+};
+
+static void draw_glyphs(struct canvas *c) {
+    /* About 3 times the height of ink per glyph, over 0.8 x 1.5 times its square */
+    double height = 2.5 * (double)c->size * (double)c->size / (double)c->budget;
+    if (height < 8.0) {
+        height = 8.0;
+    }
+    if (height > 0.125 * (double)c->size) {
+        height = 0.125 * (double)c->size;
+    }
+    double dx = 0.25 * height;
+    double dy = 0.25 * height;
+    for (double top = 2.0; (top + height < (double)c->size - 2.0) && (c->points < c->budget); top += 1.5 * height) {
+        for (double left = 2.0; (left + 0.5 * height < (double)c->size - 2.0) && (c->points < c->budget); left += 0.8 * height) {
+            const char *g = glyphs[next_random(c) % (sizeof(glyphs) / sizeof(*glyphs))];
+            double px = 0.0;
+            double py = 0.0;
+            _Bool pen = 0;
+            for (const char *p = g; *p != '\0'; ) {
+                if (*p == '|') {
+                    pen = 0;
+                    ++p;
+                    continue;
+                }
+                double x = left + dx * (double)(p[0] - '0');
+                /* Bitmap rows go upwards, text lines downwards */
+                double y = (double)(c->size - 1) - top - dy * (double)(p[1] - '0');
+                if (pen) {
+                    segment(c, px, py, x, y);
+                }
+                px = x;
+                py = y;
+                pen = 1;
+                p += 2;
+            }
+        }
+    }
+    return;
+}
+
+static struct raw_bitmap *generate(int shape, uint32_t size, size_t budget) {
+    struct raw_bitmap_info rbi = {
+        .width = size,
+        .height = size,
+        .bits_per_pixel = 1,
+        .w_ppm = 2835,
+        .h_ppm = 2835,
+        .colors_in_color_map = 2,
+    };
+    struct canvas c = {
+        .bm = create_raw_bitmap(rbi),
+        .size = size,
+        .points = 0,
+        .budget = budget,
+        .seed = UINT64_C(0x9e3779b97f4a7c15) ^ ((uint64_t)size << 8) ^ (uint64_t)shape,
+    };
+    if (c.bm == NULL) {
+        return NULL;
+    }
+    struct rgba k0 = { .b = 0, .g = 0, .r = 0, .a = 0 };
+    struct rgba k1 = { .b = 255, .g = 255, .r = 255, .a = 0 };
+    (void)set_color(c.bm, 0, k0);
+    (void)set_color(c.bm, 1, k1);
+    switch (shape) {
+        case SHAPE_CIRCLES:
+            draw_circles(&c);
+            break;
+        case SHAPE_SPIRAL:
+            draw_spiral(&c);
+            break;
+        case SHAPE_WALK:
+            draw_walk(&c);
+            break;
+        default:
+            draw_glyphs(&c);
+            break;
+    }
+    return c.bm;
+}
+
+/* Inputs of every stage, computed once per picture */
+struct bench_case {
+    const struct args_state *args;
+    const char *shape;
+    uint32_t size;
+    char *source;
+    char *output;
+    char *prefix;
+    struct raw_bitmap *bm;
+    struct points_list *pl;
+    struct points_list *cycle;
+    struct split sp;
+    struct doubles_list *sx;
+    struct doubles_list *sy;
+    struct fft_plan *plan;
+    struct raw_bitmap *picture;
+    /* Peak RSS of the child process of the stage, 0 for the stages run in this process */
+    long child_rss_kb;
+};
+
+/* Resets the peak RSS of the process to the memory in use, returns -1 when the kernel does not allow it */
+static int reset_peak_rss(void) {
+    (void)malloc_trim(0);
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t wr = write(fd, "5", 1);
+    close(fd);
+    return (wr == 1) ? 0 : -1;
+}
+
+static long peak_rss_kb(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static int run_load(struct bench_case *bc) {
+    struct raw_bitmap *bm = disk_to_bitmap(bc->source);
+    destroy_raw_bitmap(bm);
+    return (bm != NULL) ? 0 : -1;
+}
+
+static int run_get_points_list(struct bench_case *bc) {
+    struct points_list *pl = get_points_list(bc->bm, 1);
+    destroy_points_list(pl);
+    return (pl != NULL) ? 0 : -1;
+}
+
+static int run_short_cycle(struct bench_case *bc) {
+    struct points_list *pl = short_cycle(bc->pl);
+    destroy_points_list(pl);
+    return (pl != NULL) ? 0 : -1;
+}
+
+static int run_sparse_short_cycle(struct bench_case *bc) {
+    struct points_list *pl = sparse_short_cycle(bc->pl, 8);
+    destroy_points_list(pl);
+    return (pl != NULL) ? 0 : -1;
+}
+
+static int run_split(struct bench_case *bc) {
+    struct split sp = split_points_list(bc->cycle, bc->size, bc->size);
+    int r = ((sp.dlx != NULL) && (sp.dly != NULL)) ? 0 : -1;
+    destroy_doubles_list(sp.dlx);
+    destroy_doubles_list(sp.dly);
+    return r;
+}
+
+static int run_homothetie(struct bench_case *bc) {
+    struct doubles_list *dl = homothetie(bc->sp.dlx, 0.9, 0.05);
+    destroy_doubles_list(dl);
+    return (dl != NULL) ? 0 : -1;
+}
+
+static int run_scalar_product(struct bench_case *bc) {
+    volatile double sum = 0.0;
+    for (size_t m = 0; m < bc->args->modes; ++m) {
+        sum += scalar_product(bc->sp.dlx, fourier, m);
+    }
+    (void)sum;
+    return 0;
+}
+
+static int run_base_coefficients(struct bench_case *bc) {
+    struct doubles_list *sx = create_doubles_list(bc->args->modes);
+    struct doubles_list *sy = create_doubles_list(bc->args->modes);
+    int r = ((sx != NULL) && (sy != NULL)) ? 0 : -1;
+    if (r == 0) {
+        r = base_coefficients(bc->sp.dlx, fourier, sx);
+    }
+    if (r == 0) {
+        r = base_coefficients(bc->sp.dly, fourier, sy);
+    }
+    destroy_doubles_list(sx);
+    destroy_doubles_list(sy);
+    return r;
+}
+
+static int run_rebuild(struct bench_case *bc) {
+    size_t samples = get_doubles_num(bc->sp.dlx);
+    struct doubles_list *dlx = create_doubles_list(samples);
+    struct doubles_list *dly = create_doubles_list(samples);
+    int r = ((dlx != NULL) && (dly != NULL)) ? 0 : -1;
+    if (r == 0) {
+        r = rebuild_from_coefficients(dlx, fourier, bc->sx, bc->plan, bc->args->modes - 1);
+    }
+    if (r == 0) {
+        r = rebuild_from_coefficients(dly, fourier, bc->sy, bc->plan, bc->args->modes - 1);
+    }
+    destroy_doubles_list(dlx);
+    destroy_doubles_list(dly);
+    return r;
+}
+
+static int run_draw_polyline(struct bench_case *bc) {
+    struct raw_bitmap *bm = create_raw_bitmap(get_raw_bitmap_info(bc->bm));
+    int r = (bm != NULL) ? draw_polyline(bm, bc->sp.dlx, bc->sp.dly, 1) : -1;
+    destroy_raw_bitmap(bm);
+    return (r >= 0) ? 0 : -1;
+}
+
+static int run_bitmap_to_disk(struct bench_case *bc) {
+    (void)unlink(bc->output);
+    return bitmap_to_disk(bc->picture, bc->output);
+}
+
+/* Whole flow: 4 pictures up to the last mode, written as bmp files which are removed afterwards */
+static int run_mini_fourier(struct bench_case *bc) {
+    const struct args_state *args = bc->args;
+    char increment[32];
+    (void)snprintf(increment, sizeof(increment), "%zu", (args->modes + 3) / 4);
+    const char *cycle = (get_points_num(bc->pl) <= args->complete_limit) ? "complete" : "knn";
+    char *argv[] = {
+        (char *)args->mini_fourier,
+        "--source", bc->source,
+        "--destination_prefix", bc->prefix,
+        "--cycle", (char *)cycle,
+        "--pictures", "4",
+        "--mode_increment", increment,
+        "--quiet",
+        NULL,
+    };
+    pid_t pid;
+    if (posix_spawn(&pid, args->mini_fourier, NULL, NULL, argv, NULL) != 0) {
+        return -1;
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) != pid) {
+        return -1;
+    }
+    bc->child_rss_kb = ru.ru_maxrss;
+    size_t name_size = strlen(bc->prefix) + 16;
+    char *name = malloc(name_size);
+    for (size_t k = 0; (name != NULL) && (k < 4); ++k) {
+        (void)snprintf(name, name_size, "%s_%06zu.bmp", bc->prefix, k * ((args->modes + 3) / 4));
+        (void)unlink(name);
+    }
+    free(name);
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : -1;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + 1e-9 * (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/* Runs a stage warmup + repetitions times and prints its median and 95th percentile times, and its peak RSS */
+static int measure(struct bench_case *bc, const char *stage, int (*run)(struct bench_case *bc)) {
+    const struct args_state *args = bc->args;
+    double *times = malloc(args->repetitions * sizeof(*times));
+    if (times == NULL) {
+        return -1;
+    }
+    long peak = 0;
+    for (size_t i = 0; i < args->warmup + args->repetitions; ++i) {
+        (void)reset_peak_rss();
+        bc->child_rss_kb = 0;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int r = run(bc);
+        double t = elapsed_since(&start);
+        if (r != 0) {
+            dprintf(2, "%s failed on %s %" PRIu32 "\n", stage, bc->shape, bc->size);
+            free(times);
+            return -1;
+        }
+        long rss = (bc->child_rss_kb > 0) ? bc->child_rss_kb : peak_rss_kb();
+        if (i >= args->warmup) {
+            times[i - args->warmup] = t;
+            if (rss > peak) {
+                peak = rss;
+            }
+        }
+    }
+    qsort(times, args->repetitions, sizeof(*times), compare_doubles);
+    size_t n = args->repetitions;
+    double median = ((n % 2) == 1) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    /* Nearest rank */
+    double p95 = times[(95 * n + 99) / 100 - 1];
+    printf("%-8s %6" PRIu32 " %7zu %-20s %12.3f %12.3f %10ld\n", bc->shape, bc->size, get_points_num(bc->pl), stage, 1e3 * median, 1e3 * p95, peak);
+    fflush(stdout);
+    free(times);
+    return 0;
+}
+
+static void destroy_bench_case(struct bench_case *bc) {
+    free(bc->source);
+    free(bc->output);
+    free(bc->prefix);
+    destroy_raw_bitmap(bc->bm);
+    destroy_points_list(bc->pl);
+    destroy_points_list(bc->cycle);
+    destroy_doubles_list(bc->sp.dlx);
+    destroy_doubles_list(bc->sp.dly);
+    destroy_doubles_list(bc->sx);
+    destroy_doubles_list(bc->sy);
+    destroy_fft_plan(bc->plan);
+    destroy_raw_bitmap(bc->picture);
+    return;
+}
+
+/* Generates the picture, computes the inputs of the stages, then measures them */
+static int bench_picture(const struct args_state *args, int shape, uint32_t size, _Bool flow) {
+    struct bench_case bc = {
+        .args = args,
+        .shape = shape_names[shape],
+        .size = size,
+    };
+    size_t name_size = strlen(args->work) + 64;
+    bc.source = malloc(name_size);
+    bc.output = malloc(name_size);
+    bc.prefix = malloc(name_size);
+    if ((bc.source == NULL) || (bc.output == NULL) || (bc.prefix == NULL)) {
+        destroy_bench_case(&bc);
+        return -1;
+    }
+    (void)snprintf(bc.source, name_size, "%s/%s_%" PRIu32 ".bmp", args->work, bc.shape, size);
+    (void)snprintf(bc.output, name_size, "%s/%s_%" PRIu32 "_picture.bmp", args->work, bc.shape, size);
+    (void)snprintf(bc.prefix, name_size, "%s/%s_%" PRIu32 "_flow", args->work, bc.shape, size);
+    bc.bm = generate(shape, size, args->density * size);
+    (void)unlink(bc.source);
+    if ((bc.bm == NULL) || (bitmap_to_disk(bc.bm, bc.source) != 0)) {
+        dprintf(2, "Cannot generate %s\n", bc.source);
+        destroy_bench_case(&bc);
+        return -1;
+    }
+    bc.pl = get_points_list(bc.bm, 1);
+    bc.cycle = (get_points_num(bc.pl) <= args->complete_limit) ? short_cycle(bc.pl) : sparse_short_cycle(bc.pl, 8);
+    bc.sp = split_points_list(bc.cycle, size, size);
+    bc.sx = create_doubles_list(args->modes);
+    bc.sy = create_doubles_list(args->modes);
+    int r = ((bc.sp.dlx != NULL) && (bc.sp.dly != NULL) && (bc.sx != NULL) && (bc.sy != NULL)) ? 0 : -1;
+    if (r == 0) {
+        r = base_coefficients(bc.sp.dlx, fourier, bc.sx);
+    }
+    if (r == 0) {
+        r = base_coefficients(bc.sp.dly, fourier, bc.sy);
+    }
+    if (r == 0) {
+        /* Built once, like the renderer of mini_fourier does for all its pictures */
+        bc.plan = create_fft_plan(get_doubles_num(bc.sp.dlx));
+        r = (bc.plan != NULL) ? 0 : -1;
+    }
+    if (r == 0) {
+        bc.picture = create_raw_bitmap(get_raw_bitmap_info(bc.bm));
+        r = ((bc.picture != NULL) && (draw_polyline(bc.picture, bc.sp.dlx, bc.sp.dly, 1) >= 0)) ? 0 : -1;
+    }
+    if (r != 0) {
+        dprintf(2, "Cannot prepare the stages of %s\n", bc.source);
+        destroy_bench_case(&bc);
+        return -1;
+    }
+    (void)set_color(bc.picture, 1, (struct rgba){ .b = 255, .g = 255, .r = 255, .a = 0 });
+
+    r = measure(&bc, "disk_to_bitmap", run_load);
+    r |= measure(&bc, "get_points_list", run_get_points_list);
+    if (get_points_num(bc.pl) <= args->complete_limit) {
+        r |= measure(&bc, "short_cycle", run_short_cycle);
+    }
+    r |= measure(&bc, "sparse_short_cycle", run_sparse_short_cycle);
+    r |= measure(&bc, "split_points_list", run_split);
+    r |= measure(&bc, "homothetie", run_homothetie);
+    r |= measure(&bc, "scalar_product", run_scalar_product);
+    r |= measure(&bc, "base_coefficients", run_base_coefficients);
+    r |= measure(&bc, "rebuild", run_rebuild);
+    r |= measure(&bc, "draw_polyline", run_draw_polyline);
+    r |= measure(&bc, "bitmap_to_disk", run_bitmap_to_disk);
+    if (flow) {
+        r |= measure(&bc, "mini_fourier", run_mini_fourier);
+    }
+    (void)unlink(bc.output);
+    destroy_bench_case(&bc);
+    return r;
+}
+
+int main(int argc, char **argv) {
+    struct args_state args = { 0 };
+    int r;
+    r = parse_args(&args, argc, argv);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+    r = set_deflts(&args);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+
+    if (args.help_set) {
+        show_help(argv[0]);
+        return -1;
+    }
+    if ((args.density == 0) || (args.modes == 0) || (args.repetitions == 0)) {
+        dprintf(2, "Density, modes and repetitions must be at least 1\n");
+        return -1;
+    }
+    if ((mkdir(args.work, 0775) != 0) && (errno != EEXIST)) {
+        dprintf(2, "Cannot create %s (%s)\n", args.work, strerror(errno));
+        return -1;
+    }
+    set_quiet(1);
+    _Bool flow = (access(args.mini_fourier, X_OK) == 0);
+    if (!flow) {
+        dprintf(2, "%s cannot be run, the whole flow is left out\n", args.mini_fourier);
+    }
+    if (reset_peak_rss() != 0) {
+        dprintf(2, "The peak RSS cannot be reset, it is the peak since the start of the benchmark\n");
+    }
+
+    printf("%-8s %6s %7s %-20s %12s %12s %10s\n", "shape", "size", "points", "stage", "median_ms", "p95_ms", "peak_kb");
+    unsigned int failures = 0;
+    for (size_t i = 0; i < args.sizes_num; ++i) {
+        for (int s = 0; s < SHAPES; ++s) {
+            if (((args.shapes >> s) & 1) && (bench_picture(&args, s, args.sizes[i], flow) != 0)) {
+                ++failures;
+            }
+        }
+    }
+    if (failures > 0) {
+        dprintf(2, "%u pictures could not be measured\n", failures);
+    }
+    return (failures == 0) ? 0 : -1;
+}
@@ -274,16 +274,26 @@ int main(int argc, char **argv) {
 
     double dt = 1.0 / ((double)args.points);
     unsigned int failures = 0;
+    double *values = malloc(args.modes * sizeof(*values));
+    double *gram = calloc(args.modes * args.modes, sizeof(*gram));
+    if ((values == NULL) || (gram == NULL)) {
+        dprintf(2, "Cannot allocate the Gram matrix\n");
+        free(values);
+        free(gram);
+        return -1;
+    }
 
+    for (size_t k = 0; k < args.points; ++k) {
+        base_values(args.base, args.modes, ((double)k) * dt, values);
+        for (size_t i = 0; i < args.modes; ++i) {
+            for (size_t j = i; j < args.modes; ++j) {
+                gram[i * args.modes + j] += values[i] * values[j];
+            }
+        }
+    }
     for (size_t i = 0; i < args.modes; ++i) {
         for (size_t j = i; j < args.modes; ++j) {
-            double integrate = 0.0;
-            double t = 0.0;
-            for (size_t k = 0; k < args.points; ++k) {
-                integrate += args.base(i, t) * args.base(j, t);
-                t += dt;
-            }
-            integrate *= dt;
+            double integrate = gram[i * args.modes + j] * dt;
             double centered = integrate;
             if (i == j) {
                 centered -= 1.0;
@@ -294,6 +304,8 @@ int main(int argc, char **argv) {
             }
         }
     }
+    free(values);
+    free(gram);
     dprintf(2, "%u failures reported\n", failures);
     return (failures == 0) ? 0 : -1;
 }
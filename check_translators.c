@@ -0,0 +1,844 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <complex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "translators/shortcycle.h"
+#include "translators/hilbertcycle.h"
+#include "translators/strokecycle.h"
+#include "translators/disk_bitmap.h"
+#include "translators/bitmap_stream.h"
+#include "translators/analysis_cache.h"
+#include "translators/doubleslist_fourier.h"
+#include "types/fbase.h"
+#include "types/fft.h"
+#include "types/probe.h"
+
+#define CHECK_SIDE 96
+#define CHECK_THREADS 8
+#define CHECK_FRAMES 6
+#define CHECK_MODES 40
+
+/* Pixels of a lineart-like picture: grid lines, a diagonal and scattered dots, so that many edges have the same length */
+static uint8_t on[CHECK_SIDE][CHECK_SIDE];
+
+static struct points_list *check_points(void) {
+    memset(on, 0, sizeof(on));
+    uint32_t seed = 12345;
+    for (size_t y = 0; y < CHECK_SIDE; ++y) {
+        for (size_t x = 0; x < CHECK_SIDE; ++x) {
+            seed = seed * 1103515245 + 12345;
+            on[y][x] = ((x % 16) == 0) || ((y % 12) == 0) || (x == y) || (((seed >> 16) % 29) == 0);
+        }
+    }
+    size_t points_num = 0;
+    for (size_t y = 0; y < CHECK_SIDE; ++y) {
+        for (size_t x = 0; x < CHECK_SIDE; ++x) {
+            points_num += on[y][x];
+        }
+    }
+    struct points_list *pl = create_points_list(points_num);
+    size_t i = 0;
+    for (size_t y = 0; (pl != NULL) && (y < CHECK_SIDE); ++y) {
+        for (size_t x = 0; x < CHECK_SIDE; ++x) {
+            if (on[y][x]) {
+                struct point pt = {
+                    .x = x,
+                    .y = y,
+                };
+                (void)set_point_from_points_list(pl, i, &pt);
+                ++i;
+            }
+        }
+    }
+    return pl;
+}
+
+static int same_cycles(const struct points_list *a, const struct points_list *b) {
+    if ((a == NULL) || (b == NULL) || (get_points_num(a) != get_points_num(b))) {
+        return 0;
+    }
+    for (size_t i = 0; i < get_points_num(a); ++i) {
+        struct point pa;
+        struct point pb;
+        (void)get_point_from_points_list(a, i, &pa);
+        (void)get_point_from_points_list(b, i, &pb);
+        if ((pa.x != pb.x) || (pa.y != pb.y)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The Borůvka cycle must not depend on the number of threads building its tree */
+static int check_boruvka_threads(void) {
+    struct points_list *pl = check_points();
+    if (pl == NULL) {
+        return -1;
+    }
+    struct points_list *reference = parallel_short_cycle(pl, 1);
+    int r = (reference != NULL) ? 0 : -1;
+    for (size_t threads = 2; (r == 0) && (threads <= CHECK_THREADS); threads *= 2) {
+        /* Several runs, the merge order of the threads changing from one to the other */
+        for (size_t run = 0; (r == 0) && (run < 16); ++run) {
+            struct points_list *cycle = parallel_short_cycle(pl, threads);
+            if (!same_cycles(reference, cycle)) {
+                dprintf(2, "Cycle built on %zu threads differs from the one built on 1 thread\n", threads);
+                r = -1;
+            }
+            destroy_points_list(cycle);
+        }
+    }
+    destroy_points_list(reference);
+    destroy_points_list(pl);
+    return r;
+}
+
+/* Number of times each pixel of the picture appears in cycle, -1 if it holds a point out of the picture */
+static int count_visits(const struct points_list *cycle, uint32_t visits[CHECK_SIDE][CHECK_SIDE]) {
+    memset(visits, 0, CHECK_SIDE * sizeof(*visits));
+    for (size_t i = 0; i < get_points_num(cycle); ++i) {
+        struct point pt;
+        (void)get_point_from_points_list(cycle, i, &pt);
+        if ((pt.x >= CHECK_SIDE) || (pt.y >= CHECK_SIDE) || !on[pt.y][pt.x]) {
+            dprintf(2, "Point %u,%u is not a pixel of the picture\n", pt.x, pt.y);
+            return -1;
+        }
+        ++visits[pt.y][pt.x];
+    }
+    return 0;
+}
+
+/* The Hilbert order of a 256 x 256 block walks every cell once, by unit steps, and the cycle follows it */
+static int check_hilbert_cycle(void) {
+    uint32_t *cells = malloc(65536 * sizeof(*cells));
+    if (cells == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < 65536; ++i) {
+        cells[i] = UINT32_MAX;
+    }
+    int r = 0;
+    for (uint32_t y = 0; (r == 0) && (y < 256); ++y) {
+        for (uint32_t x = 0; x < 256; ++x) {
+            struct point pt = {
+                .x = x,
+                .y = y,
+            };
+            uint32_t h = hilbert_index(&pt);
+            if ((h >= 65536) || (cells[h] != UINT32_MAX)) {
+                dprintf(2, "Hilbert index of %u,%u is out of the block or taken twice\n", x, y);
+                r = -1;
+                break;
+            }
+            cells[h] = (y << 8) | x;
+        }
+    }
+    for (uint32_t h = 1; (r == 0) && (h < 65536); ++h) {
+        int dx = (int)(cells[h] & 0xff) - (int)(cells[h - 1] & 0xff);
+        int dy = (int)(cells[h] >> 8) - (int)(cells[h - 1] >> 8);
+        if (abs(dx) + abs(dy) != 1) {
+            dprintf(2, "Hilbert step %u is not a unit step\n", h);
+            r = -1;
+        }
+    }
+    free(cells);
+    struct points_list *pl = (r == 0) ? check_points() : NULL;
+    struct points_list *cycle = hilbert_cycle(pl);
+    static uint32_t visits[CHECK_SIDE][CHECK_SIDE];
+    if ((r == 0) && ((cycle == NULL) || (get_points_num(cycle) != get_points_num(pl)) || (count_visits(cycle, visits) != 0))) {
+        r = -1;
+    }
+    for (size_t y = 0; (r == 0) && (y < CHECK_SIDE); ++y) {
+        for (size_t x = 0; x < CHECK_SIDE; ++x) {
+            if (on[y][x] && (visits[y][x] != 1)) {
+                dprintf(2, "Pixel %zu,%zu is visited %u times\n", x, y, visits[y][x]);
+                r = -1;
+                break;
+            }
+        }
+    }
+    for (size_t i = 1; (r == 0) && (i < get_points_num(cycle)); ++i) {
+        struct point p0;
+        struct point p1;
+        (void)get_point_from_points_list(cycle, i - 1, &p0);
+        (void)get_point_from_points_list(cycle, i, &p1);
+        if (hilbert_index(&p0) > hilbert_index(&p1)) {
+            dprintf(2, "Cycle leaves the Hilbert order at point %zu\n", i);
+            r = -1;
+        }
+    }
+    destroy_points_list(cycle);
+    destroy_points_list(pl);
+    return r;
+}
+
+/* Number of 8-connected strokes of the picture */
+static size_t count_strokes(void) {
+    static uint8_t seen[CHECK_SIDE][CHECK_SIDE];
+    static struct point stack[CHECK_SIDE * CHECK_SIDE];
+    memset(seen, 0, sizeof(seen));
+    size_t strokes = 0;
+    for (int y0 = 0; y0 < CHECK_SIDE; ++y0) {
+        for (int x0 = 0; x0 < CHECK_SIDE; ++x0) {
+            if (!on[y0][x0] || seen[y0][x0]) {
+                continue;
+            }
+            ++strokes;
+            size_t depth = 0;
+            seen[y0][x0] = 1;
+            stack[depth++] = (struct point){ .x = x0, .y = y0 };
+            while (depth > 0) {
+                struct point pt = stack[--depth];
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int x = pt.x + dx;
+                        int y = pt.y + dy;
+                        if ((x >= 0) && (y >= 0) && (x < CHECK_SIDE) && (y < CHECK_SIDE) && on[y][x] && !seen[y][x]) {
+                            seen[y][x] = 1;
+                            stack[depth++] = (struct point){ .x = x, .y = y };
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return strokes;
+}
+
+/* The stroke cycle visits every pixel, by 8-adjacent steps except for one jump to a new pixel per stroke left */
+static int check_stroke_cycle(void) {
+    struct points_list *pl = check_points();
+    struct points_list *cycle = stroke_cycle(pl);
+    static uint32_t visits[CHECK_SIDE][CHECK_SIDE];
+    static uint8_t reached[CHECK_SIDE][CHECK_SIDE];
+    int r = ((cycle != NULL) && (count_visits(cycle, visits) == 0)) ? 0 : -1;
+    for (size_t y = 0; (r == 0) && (y < CHECK_SIDE); ++y) {
+        for (size_t x = 0; x < CHECK_SIDE; ++x) {
+            if (on[y][x] && (visits[y][x] == 0)) {
+                dprintf(2, "Pixel %zu,%zu is not visited\n", x, y);
+                r = -1;
+                break;
+            }
+        }
+    }
+    memset(reached, 0, sizeof(reached));
+    size_t jumps = 0;
+    for (size_t i = 0; (r == 0) && (i < get_points_num(cycle)); ++i) {
+        struct point p1;
+        (void)get_point_from_points_list(cycle, i, &p1);
+        if (i > 0) {
+            struct point p0;
+            (void)get_point_from_points_list(cycle, i - 1, &p0);
+            int dx = abs((int)p1.x - (int)p0.x);
+            int dy = abs((int)p1.y - (int)p0.y);
+            if ((dx > 1) || (dy > 1) || (dx + dy == 0)) {
+                if (reached[p1.y][p1.x]) {
+                    dprintf(2, "Step %zu jumps back to a visited pixel\n", i);
+                    r = -1;
+                }
+                ++jumps;
+            }
+        }
+        reached[p1.y][p1.x] = 1;
+    }
+    size_t strokes = count_strokes();
+    if ((r == 0) && (jumps + 1 != strokes)) {
+        dprintf(2, "Cycle jumps %zu times between %zu strokes\n", jumps, strokes);
+        r = -1;
+    }
+    destroy_points_list(cycle);
+    destroy_points_list(pl);
+    return r;
+}
+
+/* Whether fname is mapped in this process, -1 if the mappings cannot be listed */
+static int is_mapped(const char *fname) {
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (maps == NULL) {
+        return -1;
+    }
+    char line[4096];
+    int found = 0;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        size_t len = strlen(line);
+        size_t name_len = strlen(fname);
+        if ((len >= name_len) && (strcmp(line + len - name_len, fname) == 0)) {
+            found = 1;
+        }
+    }
+    fclose(maps);
+    return found;
+}
+
+/* Writes an ordinary file of the given depth (pixels at offset 54 + 4 * colors, 2 modulo 4) and loads it back */
+static int check_mapped_depth(uint16_t bits_per_pixel, uint32_t colors) {
+    struct raw_bitmap_info rbi = {
+        .width = 37,
+        .height = 23,
+        .bits_per_pixel = bits_per_pixel,
+        .w_ppm = 2835,
+        .h_ppm = 2835,
+        .colors_in_color_map = colors,
+    };
+    uint32_t mask = (bits_per_pixel < 32) ? (UINT32_C(1) << bits_per_pixel) - 1 : UINT32_MAX;
+    struct raw_bitmap *bm0 = create_raw_bitmap(rbi);
+    if (bm0 == NULL) {
+        return -1;
+    }
+    for (uint32_t c = 0; c < colors; ++c) {
+        (void)set_color(bm0, c, (struct rgba){ .b = c, .g = c, .r = c, .a = 0 });
+    }
+    for (uint32_t y = 0; y < rbi.height; ++y) {
+        for (uint32_t x = 0; x < rbi.width; ++x) {
+            (void)set_pixel(bm0, x, y, (x * 2654435761u + y * 40503u) & mask);
+        }
+    }
+    char fname[64];
+    (void)snprintf(fname, sizeof(fname), "/tmp/check_translators_%ld_%u.bmp", (long)getpid(), bits_per_pixel);
+    (void)unlink(fname);
+    int r = bitmap_to_disk(bm0, fname);
+    struct raw_bitmap *bm1 = (r == 0) ? disk_to_bitmap(fname) : NULL;
+    if (bm1 == NULL) {
+        dprintf(2, "Cannot write and load back %s\n", fname);
+        r = -1;
+    } else if (is_mapped(fname) != 1) {
+        dprintf(2, "The %u bits per pixel file was copied instead of being mapped\n", bits_per_pixel);
+        r = -1;
+    }
+    for (uint32_t y = 0; (r == 0) && (y < rbi.height); ++y) {
+        for (uint32_t x = 0; x < rbi.width; ++x) {
+            uint32_t c0;
+            uint32_t c1;
+            if ((get_pixel(bm0, x, y, &c0) != 0) || (get_pixel(bm1, x, y, &c1) != 0) || (c0 != c1)) {
+                dprintf(2, "Pixel %u,%u differs once loaded at %u bits per pixel\n", x, y, bits_per_pixel);
+                r = -1;
+                break;
+            }
+        }
+    }
+    destroy_raw_bitmap(bm1);
+    if ((r == 0) && (is_mapped(fname) != 0)) {
+        dprintf(2, "The mapping outlives the bitmap\n");
+        r = -1;
+    }
+    (void)unlink(fname);
+    destroy_raw_bitmap(bm0);
+    return r;
+}
+
+/* Uncompressed files are read in place, though their pixel array is not 32 bits aligned */
+static int check_bitmap_mapping(void) {
+    int r = check_mapped_depth(1, 2);
+    if (r == 0) {
+        r = check_mapped_depth(8, 256);
+    }
+    if (r == 0) {
+        r = check_mapped_depth(24, 0);
+    }
+    if (r == 0) {
+        r = check_mapped_depth(32, 0);
+    }
+    return r;
+}
+
+/* Uniform in [-1, 1) */
+static double check_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return ((double)(*seed >> 8) / (double)(1u << 24)) * 2.0 - 1.0;
+}
+
+/* Rows of each kind the encoder handles: a single run, noise, lone pixels and pairs between runs, runs of any length, trailing blank */
+static uint32_t rle_color(uint32_t x, uint32_t y, uint32_t mask, uint32_t *seed, uint32_t *run, uint32_t *color) {
+    switch (y % 5) {
+    case 0:
+        return (y / 5) & mask;
+    case 1:
+        return (uint32_t)((check_random(seed) + 1.0) * 0.5 * (mask + 1)) & mask;
+    case 2:
+        return ((x % 11 == 4) || (x % 11 >= 9)) ? (x + y) & mask : (x / 11 + 1) & mask;
+    case 3:
+        if (*run == 0) {
+            *run = 1 + (uint32_t)((check_random(seed) + 1.0) * 150);
+            *color = (uint32_t)((check_random(seed) + 1.0) * 0.5 * (mask + 1)) & mask;
+        }
+        --*run;
+        return *color;
+    default:
+        return (x < y) ? (x * 7 + 1) & mask : 0;
+    }
+}
+
+static int check_rle_width(uint16_t bits_per_pixel, uint32_t width) {
+    struct raw_bitmap_info rbi = {
+        .width = width,
+        .height = 15,
+        .bits_per_pixel = bits_per_pixel,
+        .w_ppm = 2835,
+        .h_ppm = 2835,
+        .colors_in_color_map = UINT32_C(1) << bits_per_pixel,
+    };
+    uint32_t mask = (UINT32_C(1) << bits_per_pixel) - 1;
+    struct raw_bitmap *bm0 = create_raw_bitmap(rbi);
+    if (bm0 == NULL) {
+        return -1;
+    }
+    for (uint32_t c = 0; c <= mask; ++c) {
+        (void)set_color(bm0, c, (struct rgba){ .b = c, .g = c, .r = c, .a = 0 });
+    }
+    uint32_t seed = width;
+    for (uint32_t y = 0; y < rbi.height; ++y) {
+        uint32_t run = 0;
+        uint32_t color = 0;
+        for (uint32_t x = 0; x < rbi.width; ++x) {
+            (void)set_pixel(bm0, x, y, rle_color(x, y, mask, &seed, &run, &color));
+        }
+    }
+    char fname[64];
+    (void)snprintf(fname, sizeof(fname), "/tmp/check_translators_%ld_%u_%u.bmp", (long)getpid(), bits_per_pixel, width);
+    (void)unlink(fname);
+    int r = bitmap_to_disk_rle(bm0, fname);
+    struct raw_bitmap *bm1 = (r == 0) ? disk_to_bitmap(fname) : NULL;
+    if (bm1 == NULL) {
+        dprintf(2, "Cannot write and load back %s\n", fname);
+        r = -1;
+    }
+    for (uint32_t y = 0; (r == 0) && (y < rbi.height); ++y) {
+        for (uint32_t x = 0; x < rbi.width; ++x) {
+            uint32_t c0;
+            uint32_t c1;
+            if ((get_pixel(bm0, x, y, &c0) != 0) || (get_pixel(bm1, x, y, &c1) != 0) || (c0 != c1)) {
+                dprintf(2, "Pixel %u,%u differs once run length encoded at %u bits per pixel, %u wide\n", x, y, bits_per_pixel, width);
+                r = -1;
+                break;
+            }
+        }
+    }
+    destroy_raw_bitmap(bm1);
+    (void)unlink(fname);
+    destroy_raw_bitmap(bm0);
+    return r;
+}
+
+/* 1 bit canvases go through RLE4, odd widths end on half a byte, long rows split their runs at 255 pixels */
+static int check_bitmap_rle(void) {
+    static const struct {
+        uint16_t bits_per_pixel;
+        uint32_t width;
+    } cases[] = { { 1, 37 }, { 1, 301 }, { 4, 1 }, { 4, 2 }, { 4, 3 }, { 4, 37 }, { 4, 301 }, { 8, 1 }, { 8, 37 }, { 8, 301 }, { 8, 600 } };
+    int r = 0;
+    for (size_t k = 0; (r == 0) && (k < sizeof(cases) / sizeof(cases[0])); ++k) {
+        r = check_rle_width(cases[k].bits_per_pixel, cases[k].width);
+    }
+    return r;
+}
+
+/* load_analysis of an entry expected to be rejected, its warning going to /dev/null */
+static int load_stale(const char *fname, uint64_t key) {
+    struct points_list *cycle;
+    struct doubles_list *sx;
+    struct doubles_list *sy;
+    int saved = dup(2);
+    int null = open("/dev/null", O_WRONLY);
+    if ((saved != -1) && (null != -1)) {
+        (void)dup2(null, 2);
+    }
+    int r = load_analysis(fname, key, CHECK_MODES, &cycle, &sx, &sy);
+    if (saved != -1) {
+        (void)dup2(saved, 2);
+        close(saved);
+    }
+    if (null != -1) {
+        close(null);
+    }
+    if ((r == 0) || (cycle != NULL) || (sx != NULL) || (sy != NULL)) {
+        destroy_points_list(cycle);
+        destroy_doubles_list(sx);
+        destroy_doubles_list(sy);
+        return -1;
+    }
+    return 0;
+}
+
+/* A stored analysis loads back as it was, its coefficients mapped until both lists are gone; other keys, versions and sizes are stale */
+static int check_analysis_cache(void) {
+    const uint64_t key = hash_bytes(ANALYSIS_HASH_SEED, "check", 5);
+    struct points_list *cycle0 = check_points();
+    struct doubles_list *sx0 = create_doubles_list(CHECK_MODES);
+    struct doubles_list *sy0 = create_doubles_list(CHECK_MODES);
+    char fname[64];
+    (void)snprintf(fname, sizeof(fname), "/tmp/check_translators_%ld.cache", (long)getpid());
+    int r = ((cycle0 != NULL) && (sx0 != NULL) && (sy0 != NULL)) ? 0 : -1;
+    uint32_t seed = 99;
+    for (size_t k = 0; (r == 0) && (k < CHECK_MODES); ++k) {
+        set_double_from_doubles_list(sx0, k, check_random(&seed) * 1e3);
+        set_double_from_doubles_list(sy0, k, check_random(&seed) / 7.0);
+    }
+    if ((r == 0) && (store_analysis(fname, key, cycle0, sx0, sy0) != 0)) {
+        dprintf(2, "Cannot store the analysis in %s\n", fname);
+        r = -1;
+    }
+    struct points_list *cycle = NULL;
+    struct doubles_list *sx = NULL;
+    struct doubles_list *sy = NULL;
+    if ((r == 0) && ((load_analysis(fname, key, CHECK_MODES, &cycle, &sx, &sy) != 0) || !same_cycles(cycle0, cycle) || (sx == NULL) || (sy == NULL)
+            || (get_doubles_num(sx) != CHECK_MODES) || (get_doubles_num(sy) != CHECK_MODES)
+            || (memcmp(get_doubles_array(sx), get_doubles_array(sx0), CHECK_MODES * sizeof(double)) != 0)
+            || (memcmp(get_doubles_array(sy), get_doubles_array(sy0), CHECK_MODES * sizeof(double)) != 0))) {
+        dprintf(2, "The analysis does not load back as stored\n");
+        r = -1;
+    }
+    if ((r == 0) && (is_mapped(fname) != 1)) {
+        dprintf(2, "The coefficients are not mapped from the cache file\n");
+        r = -1;
+    }
+    destroy_doubles_list(sx);
+    if ((r == 0) && (is_mapped(fname) != 1)) {
+        dprintf(2, "The cache file is unmapped while the Y coefficients still use it\n");
+        r = -1;
+    }
+    destroy_doubles_list(sy);
+    if ((r == 0) && (is_mapped(fname) != 0)) {
+        dprintf(2, "The cache file stays mapped once both lists are destroyed\n");
+        r = -1;
+    }
+    destroy_points_list(cycle);
+    cycle = NULL;
+    sx = NULL;
+    sy = NULL;
+    if ((r == 0) && ((load_analysis(fname, key, CHECK_MODES + 1, &cycle, &sx, &sy) != 0) || !same_cycles(cycle0, cycle) || (sx != NULL) || (sy != NULL)
+            || (is_mapped(fname) != 0))) {
+        dprintf(2, "A file with fewer modes than asked does not give the cycle alone\n");
+        r = -1;
+    }
+    destroy_points_list(cycle);
+    destroy_doubles_list(sx);
+    destroy_doubles_list(sy);
+    if ((r == 0) && (load_stale(fname, key + 1) != 0)) {
+        dprintf(2, "An entry is loaded for another key\n");
+        r = -1;
+    }
+    /* The version follows the 8 bytes of the magic */
+    uint32_t version = ANALYSIS_CACHE_VERSION + 1;
+    int fd = (r == 0) ? open(fname, O_WRONLY) : -1;
+    if ((r == 0) && ((fd == -1) || (pwrite(fd, &version, sizeof(version), 8) != sizeof(version)) || (load_stale(fname, key) != 0))) {
+        dprintf(2, "An entry of another version is not rejected\n");
+        r = -1;
+    }
+    version = ANALYSIS_CACHE_VERSION;
+    struct stat st;
+    if ((r == 0) && ((pwrite(fd, &version, sizeof(version), 8) != sizeof(version)) || (fstat(fd, &st) != 0) || (ftruncate(fd, st.st_size - 1) != 0)
+            || (load_stale(fname, key) != 0))) {
+        dprintf(2, "An entry of the wrong size is not rejected\n");
+        r = -1;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    (void)unlink(fname);
+    destroy_doubles_list(sx0);
+    destroy_doubles_list(sy0);
+    destroy_points_list(cycle0);
+    return r;
+}
+
+/* Radix only, prime above the largest radix (Bluestein), odd, even and degenerate lengths */
+static const size_t fft_lengths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 16, 31, 32, 37, 64, 74, 97, 100, 101, 210, 243, 256, 303, 1000, 1009 };
+
+static double max_error(const double *a, const double *b, size_t num) {
+    double err = 0.0;
+    for (size_t i = 0; i < num; ++i) {
+        double d = fabs(a[i] - b[i]);
+        if (d > err) {
+            err = d;
+        }
+    }
+    return err;
+}
+
+/* fft_forward and fft_backward against the direct sums */
+static int check_fft_length(size_t points, uint32_t *seed) {
+    struct fft_plan *plan = create_fft_plan(points);
+    double complex *data = malloc(4 * points * sizeof(*data));
+    if ((plan == NULL) || (data == NULL)) {
+        destroy_fft_plan(plan);
+        free(data);
+        return -1;
+    }
+    double complex *in = data;
+    double complex *out = data + points;
+    double complex *back = data + 2 * points;
+    double complex *direct = data + 3 * points;
+    for (size_t n = 0; n < points; ++n) {
+        in[n] = CMPLX(check_random(seed), check_random(seed));
+    }
+    int r = fft_forward(plan, in, out);
+    if (r == 0) {
+        r = fft_backward(plan, out, back);
+    }
+    double err = 0.0;
+    for (size_t k = 0; (r == 0) && (k < points); ++k) {
+        direct[k] = 0.0;
+        for (size_t n = 0; n < points; ++n) {
+            direct[k] += in[n] * cexp(CMPLX(0.0, -2.0 * M_PI * (double)((k * n) % points) / (double)points));
+        }
+        err = fmax(err, cabs(direct[k] - out[k]));
+        /* The backward transform is not normalised */
+        err = fmax(err, cabs(back[k] / (double)points - in[k]));
+    }
+    if ((r != 0) || (err > 1e-9 * (double)points)) {
+        dprintf(2, "FFT of %zu points is off by %g\n", points, err);
+        r = -1;
+    }
+    destroy_fft_plan(plan);
+    free(data);
+    return r;
+}
+
+/* base_coefficients and rebuild_from_coefficients against scalar_product and add_base_vector, modes past points included */
+static int check_fourier_length(size_t points, uint32_t *seed) {
+    size_t modes = 2 * points + 2;
+    struct doubles_list *dl = create_doubles_list(points);
+    struct doubles_list *coefs = create_doubles_list(modes);
+    struct doubles_list *fast = create_doubles_list(points);
+    struct doubles_list *slow = create_doubles_list(points);
+    struct fft_plan *plan = create_fft_plan(points);
+    int r = ((dl != NULL) && (coefs != NULL) && (fast != NULL) && (slow != NULL) && (plan != NULL)) ? 0 : -1;
+    for (size_t i = 0; (r == 0) && (i < points); ++i) {
+        set_double_from_doubles_list(dl, i, check_random(seed));
+    }
+    if (r == 0) {
+        r = base_coefficients(dl, fourier, coefs);
+    }
+    double err = 0.0;
+    for (size_t mode = 0; (r == 0) && (mode < modes); ++mode) {
+        err = fmax(err, fabs(get_double_from_doubles_list(coefs, mode) - scalar_product(dl, fourier, mode)));
+    }
+    if ((r == 0) && (err > 1e-10)) {
+        dprintf(2, "Fourier coefficients of %zu points are off by %g\n", points, err);
+        r = -1;
+    }
+    /* Every mode at once, past the threshold of the inverse FFT */
+    if (r == 0) {
+        r = rebuild_from_coefficients(fast, fourier, coefs, plan, modes - 1);
+    }
+    for (size_t mode = 0; (r == 0) && (mode < modes); ++mode) {
+        add_base_vector(slow, fourier, mode, get_double_from_doubles_list(coefs, mode));
+    }
+    if (r == 0) {
+        err = max_error(get_doubles_array(fast), get_doubles_array(slow), points);
+        if (err > 1e-9) {
+            dprintf(2, "Fourier rebuild of %zu points is off by %g\n", points, err);
+            r = -1;
+        }
+    }
+    destroy_doubles_list(dl);
+    destroy_doubles_list(coefs);
+    destroy_doubles_list(fast);
+    destroy_doubles_list(slow);
+    destroy_fft_plan(plan);
+    return r;
+}
+
+static int check_fft(void) {
+    uint32_t seed = 2024;
+    int r = 0;
+    for (size_t i = 0; (r == 0) && (i < sizeof(fft_lengths) / sizeof(fft_lengths[0])); ++i) {
+        r = check_fft_length(fft_lengths[i], &seed);
+    }
+    return r;
+}
+
+static int check_fourier_base(void) {
+    uint32_t seed = 4096;
+    int r = 0;
+    for (size_t i = 0; (r == 0) && (i < sizeof(fft_lengths) / sizeof(fft_lengths[0])); ++i) {
+        r = check_fourier_length(fft_lengths[i], &seed);
+    }
+    return r;
+}
+
+static int same_pixels(const struct raw_bitmap *bm0, const struct raw_bitmap *bm1) {
+    struct raw_bitmap_info rbi0 = get_raw_bitmap_info(bm0);
+    struct raw_bitmap_info rbi1 = get_raw_bitmap_info(bm1);
+    if ((rbi0.width != rbi1.width) || (rbi0.height != rbi1.height) || (rbi0.bits_per_pixel != rbi1.bits_per_pixel)) {
+        return 0;
+    }
+    for (uint32_t y = 0; y < rbi0.height; ++y) {
+        for (uint32_t x = 0; x < rbi0.width; ++x) {
+            uint32_t c0;
+            uint32_t c1;
+            if ((get_pixel(bm0, x, y, &c0) != 0) || (get_pixel(bm1, x, y, &c1) != 0) || (c0 != c1)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Reads fname back, expecting the frames and labels written, or an error before the end when truncated */
+static int read_delta(const char *fname, struct raw_bitmap **frames, const uint32_t *labels, _Bool truncated) {
+    struct delta_reader *dr = open_delta_reader(fname);
+    if (dr == NULL) {
+        return -1;
+    }
+    int r = 0;
+    size_t k = 0;
+    const struct raw_bitmap *bm;
+    uint32_t label;
+    while ((bm = next_delta_frame(dr, &label)) != NULL) {
+        if ((k >= CHECK_FRAMES) || (label != labels[k]) || !same_pixels(bm, frames[k])) {
+            dprintf(2, "Frame %zu of the delta stream is not the one written\n", k);
+            r = -1;
+            break;
+        }
+        ++k;
+    }
+    int closed = close_delta_reader(dr);
+    if (truncated) {
+        if ((r == 0) && ((closed != -1) || (k >= CHECK_FRAMES))) {
+            dprintf(2, "The truncated delta stream is not reported as corrupted\n");
+            r = -1;
+        }
+    } else if ((r == 0) && ((closed != 0) || (k != CHECK_FRAMES))) {
+        dprintf(2, "The delta stream holds %zu frames out of %d\n", k, CHECK_FRAMES);
+        r = -1;
+    }
+    return r;
+}
+
+/* Frames written as a delta stream come back with their labels, a truncated stream ending on an error */
+static int check_delta_stream(void) {
+    struct raw_bitmap_info rbi = {
+        .width = 45,
+        .height = 19,
+        .bits_per_pixel = 1,
+        .w_ppm = 2835,
+        .h_ppm = 2835,
+        .colors_in_color_map = 2,
+    };
+    struct raw_bitmap *frames[CHECK_FRAMES] = { NULL };
+    uint32_t labels[CHECK_FRAMES];
+    char fname[64];
+    (void)snprintf(fname, sizeof(fname), "/tmp/check_translators_%ld.delta", (long)getpid());
+    struct bitmap_stream *bs = open_bitmap_stream(fname, BITMAP_STREAM_DELTA, rbi.width, rbi.height);
+    int r = (bs != NULL) ? 0 : -1;
+    uint32_t seed = 77;
+    for (size_t k = 0; (r == 0) && (k < CHECK_FRAMES); ++k) {
+        frames[k] = create_raw_bitmap(rbi);
+        if (frames[k] == NULL) {
+            r = -1;
+            break;
+        }
+        (void)set_color(frames[k], 1, (struct rgba){ .b = 255, .g = 255, .r = 255, .a = 0 });
+        /* Each frame changes a few pixels of the previous one, the third one none */
+        for (uint32_t y = 0; (k > 0) && (y < rbi.height); ++y) {
+            for (uint32_t x = 0; x < rbi.width; ++x) {
+                uint32_t c;
+                (void)get_pixel(frames[k - 1], x, y, &c);
+                if ((k != 2) && (check_random(&seed) > 0.8)) {
+                    c ^= 1;
+                }
+                (void)set_pixel(frames[k], x, y, c);
+            }
+        }
+        labels[k] = 100 * k + 7;
+        r = stream_bitmap(bs, frames[k], labels[k]);
+    }
+    if ((bs != NULL) && (close_bitmap_stream(bs) != 0)) {
+        r = -1;
+    }
+    if (r == 0) {
+        r = read_delta(fname, frames, labels, 0);
+    }
+    struct stat st;
+    if ((r == 0) && ((stat(fname, &st) != 0) || (truncate(fname, st.st_size - 5) != 0))) {
+        r = -1;
+    }
+    if (r == 0) {
+        r = read_delta(fname, frames, labels, 1);
+    }
+    (void)unlink(fname);
+    for (size_t k = 0; k < CHECK_FRAMES; ++k) {
+        destroy_raw_bitmap(frames[k]);
+    }
+    return r;
+}
+
+struct check {
+    const char *name;
+    int (*run)(void);
+};
+
+static struct check checks[] = {
+    {
+        .name = "boruvka_threads",
+        .run = check_boruvka_threads,
+    },
+    {
+        .name = "hilbert_cycle",
+        .run = check_hilbert_cycle,
+    },
+    {
+        .name = "stroke_cycle",
+        .run = check_stroke_cycle,
+    },
+    {
+        .name = "bitmap_mapping",
+        .run = check_bitmap_mapping,
+    },
+    {
+        .name = "bitmap_rle",
+        .run = check_bitmap_rle,
+    },
+    {
+        .name = "delta_stream",
+        .run = check_delta_stream,
+    },
+    {
+        .name = "analysis_cache",
+        .run = check_analysis_cache,
+    },
+    {
+        .name = "fft",
+        .run = check_fft,
+    },
+    {
+        .name = "fourier_base",
+        .run = check_fourier_base,
+    },
+};
+
+/* Runs the checks named on the command line, all of them without argument */
+int main(int argc, char **argv) {
+    size_t checks_num = sizeof(checks) / sizeof(checks[0]);
+    int failed = 0;
+    int matched = 0;
+    set_quiet(1);
+    for (size_t c = 0; c < checks_num; ++c) {
+        _Bool wanted = (argc < 2);
+        for (int a = 1; a < argc; ++a) {
+            if (strcmp(argv[a], checks[c].name) == 0) {
+                wanted = 1;
+            }
+        }
+        if (!wanted) {
+            continue;
+        }
+        ++matched;
+        int r = checks[c].run();
+        printf("%-24s %s\n", checks[c].name, (r == 0) ? "ok" : "FAILED");
+        if (r != 0) {
+            ++failed;
+        }
+    }
+    if (matched == 0) {
+        dprintf(2, "No such check\n");
+        return -1;
+    }
+    return (failed == 0) ? 0 : -1;
+}
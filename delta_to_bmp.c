@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "translators/bitmap_stream.h"
+#include "translators/disk_bitmap.h"
+
+struct args_state {
+    const char *source;
+    const char *dest_prefix;
+    size_t frame;
+    unsigned int frame_set:1;
+    unsigned int help_set:1;
+};
+
+static int parse_source(const char *arg, struct args_state *state) {
+    if (state->source != NULL) {
+        dprintf(2, "Source is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (source)\n");
+        return -1;
+    }
+    state->source = arg;
+    return 0;
+}
+
+static int parse_destination_prefix(const char *arg, struct args_state *state) {
+    if (state->dest_prefix != NULL) {
+        dprintf(2, "Destination prefix is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (destination_prefix)\n");
+        return -1;
+    }
+    state->dest_prefix = arg;
+    return 0;
+}
+
+static int parse_frame(const char *arg, struct args_state *state) {
+    if (state->frame_set) {
+        dprintf(2, "Frame is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (frame)\n");
+        return -1;
+    }
+    char *end = NULL;
+    state->frame = strtoull(arg, &end, 0);
+    if (*end != '\0') {
+        dprintf(2, "Cannot parse frame\n");
+        return -1;
+    }
+    state->frame_set = 1;
+    return 0;
+}
+
+static int parse_help(const char *arg, struct args_state *state) {
+    if (state->help_set) {
+        dprintf(2, "Help is already set\n");
+        return -1;
+    }
+    if (arg != NULL) {
+        dprintf(2, "Unexpected parameter (help)\n");
+        return -1;
+    }
+    state->help_set = 1;
+    return 0;
+}
+
+struct option {
+    const char *arg_name;
+    const char *parameter_name;
+    const char *description;
+    const char *deflt;
+    int (*parse)(const char *arg, struct args_state *state);
+};
+
+static struct option options[] = {
+    {
+        .arg_name = "source",
+        .parameter_name = "file_name",
+        .description = "<file_name> is a delta stream written by mini_fourier --output delta, \"-\" being the standard input",
+        .parse = parse_source,
+        .deflt = NULL,
+    },
+    {
+        .arg_name = "destination_prefix",
+        .parameter_name = "file_name_prefix",
+        .description = "<file_name_prefix> must be a prefix for all generated files",
+        .parse = parse_destination_prefix,
+        .deflt = NULL,
+    },
+    {
+        .arg_name = "frame",
+        .parameter_name = "index",
+        .description = "<index> is the only frame to write (counting from 0, whatever the mode naming it)",
+        .parse = parse_frame,
+        .deflt = "all frames",
+    },
+    {
+        .arg_name = "help",
+        .parameter_name = NULL,
+        .description = "Prints this help",
+        .parse = parse_help,
+        .deflt = NULL,
+    },
+    { 0 }
+};
+
+
+static void show_help(const char *cmd) {
+    dprintf(2, "%s ", cmd);
+    struct option *opt;
+    opt = options;
+    while (opt->arg_name != NULL) {
+        _Bool mandatory = (opt->parameter_name != NULL) && (opt->deflt == NULL);
+        if (!mandatory) {
+            dprintf(2, "[");
+        }
+        dprintf(2, "--%s", opt->arg_name);
+        if (opt->parameter_name != NULL) {
+            dprintf(2, " <%s>", opt->parameter_name);
+        }
+        if (!mandatory) {
+            dprintf(2, "]");
+        }
+        dprintf(2, " ");
+        ++opt;
+    }
+    dprintf(2, "\n");
+    opt = options;
+    while (opt->arg_name != NULL) {
+        dprintf(2, "  --%s", opt->arg_name);
+        if (opt->parameter_name != NULL) {
+            dprintf(2, " <%s>", opt->parameter_name);
+        }
+        dprintf(2, ": %s", opt->description);
+        if (opt->deflt != NULL) {
+            dprintf(2, " (deflt is \"%s\")", opt->deflt);
+        }
+        dprintf(2, "\n");
+        ++opt;
+    }
+    return;
+}
+
+static int parse_args(struct args_state *args, int argc, char **argv) {
+    int i = 1;
+    while (i < argc) {
+        if ((argv[i][0] == '\0') || (argv[i][1] == '\0')) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        if ((argv[i][0] != '-') || (argv[i][1] != '-')) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        struct option *opt = options;
+        while (opt->arg_name != NULL) {
+            if (strcmp(argv[i] + 2, opt->arg_name) == 0) {
+                break;
+            }
+            ++opt;
+        }
+        if (opt->arg_name == NULL) {
+            dprintf(2, "%s: invalid argument\n", argv[i]);
+            return -1;
+        }
+        const char *param = NULL;
+        if (opt->parameter_name != NULL) {
+            ++i;
+            if (i >= argc) {
+                dprintf(2, "%s: missing parameter\n", argv[i-1]);
+                return -1;
+            }
+            param = argv[i];
+        }
+        int r = opt->parse(param, args);
+        if (r != 0) {
+            return -1;
+        }
+        ++i;
+    }
+    return 0;
+}
+
+static int set_deflts(struct args_state *args) {
+    if (args->source == NULL) {
+        dprintf(2, "Missing source\n");
+        return -1;
+    }
+    if (args->dest_prefix == NULL) {
+        dprintf(2, "Missing destination prefix\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct args_state args = { 0 };
+    int r;
+    r = parse_args(&args, argc, argv);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+    r = set_deflts(&args);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+
+    if (args.help_set) {
+        show_help(argv[0]);
+        return -1;
+    }
+    static char file_name[256];
+    if ((strlen(args.dest_prefix) + 16) >= sizeof(file_name)) {
+        dprintf(2, "File name is too long\n");
+        return -1;
+    }
+
+    struct delta_reader *dr = open_delta_reader(args.source);
+    if (dr == NULL) {
+        dprintf(2, "Cannot read the delta stream\n");
+        return -1;
+    }
+    int ret = 0;
+    size_t frames = 0;
+    const struct raw_bitmap *bm;
+    uint32_t label;
+    while ((bm = next_delta_frame(dr, &label)) != NULL) {
+        if ((args.frame_set == 0) || (args.frame == frames)) {
+            /* Named after the mode of the picture, as mini_fourier names its bmp outputs */
+            (void)sprintf(file_name, "%s_%06" PRIu32 ".bmp", args.dest_prefix, label);
+            if (bitmap_to_disk(bm, file_name) != 0) {
+                dprintf(2, "Write error\n");
+                ret = -1;
+                break;
+            }
+        }
+        ++frames;
+        if (args.frame_set && (frames > args.frame)) {
+            break;
+        }
+    }
+    if ((close_delta_reader(dr) != 0) && (ret == 0)) {
+        dprintf(2, "Corrupted delta stream\n");
+        ret = -1;
+    }
+    if ((ret == 0) && args.frame_set && (frames <= args.frame)) {
+        dprintf(2, "The stream only holds %zu frames\n", frames);
+        ret = -1;
+    }
+    dprintf(2, "%zu frames decoded\n", frames);
+    return ret;
+}
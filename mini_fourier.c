@@ -3,18 +3,47 @@
 #include <string.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include "translators/disk_bitmap.h"
 #include "translators/bitmap_pointslist.h"
 #include "translators/shortcycle.h"
+#include "translators/hilbertcycle.h"
+#include "translators/strokecycle.h"
+#include "translators/doubleslist_bitmap.h"
+#include "translators/bitmap_stream.h"
 #include "translators/pointslist_doubleslist.h"
 #include "translators/doubleslist_fourier.h"
 #include "translators/homothetie.h"
+#include "translators/analysis_cache.h"
 #include "types/fbase.h"
+#include "types/probe.h"
 
 struct args_state {
     const char *source;
+    const char *batch;
+    const char *serve;
     const char *dest_prefix;
     double (*base)(size_t,double);
+    const char *base_name;
+    struct points_list *(*cycle)(const struct points_list *pl, const struct args_state *args);
+    const char *cycle_name;
+    size_t neighbours;
+    size_t threads;
+    double cycle_budget;
+    int (*draw)(struct raw_bitmap *bm, struct split sp, const struct raw_bitmap_info *rbi);
+    size_t samples;
+    int output;
+    const char *stream;
+    const char *cache_dir;
+    const char *report;
     size_t starting_mode;
     size_t mode_increment;
     size_t mode_quad;
@@ -23,6 +52,14 @@ struct args_state {
     double xshift;
     double yscale;
     double yshift;
+    unsigned int neighbours_set:1;
+    unsigned int threads_set:1;
+    unsigned int cycle_budget_set:1;
+    unsigned int samples_set:1;
+    unsigned int output_set:1;
+    unsigned int rle_set:1;
+    unsigned int quiet_set:1;
+    unsigned int perf_set:1;
     unsigned int starting_mode_set:1;
     unsigned int mode_increment_set:1;
     unsigned int mode_quad_set:1;
@@ -47,6 +84,32 @@ static int parse_source(const char *arg, struct args_state *state) {
     return 0;
 }
 
+static int parse_batch(const char *arg, struct args_state *state) {
+    if (state->batch != NULL) {
+        dprintf(2, "Batch is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (batch)\n");
+        return -1;
+    }
+    state->batch = arg;
+    return 0;
+}
+
+static int parse_serve(const char *arg, struct args_state *state) {
+    if (state->serve != NULL) {
+        dprintf(2, "Server socket is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (serve)\n");
+        return -1;
+    }
+    state->serve = arg;
+    return 0;
+}
+
 static int parse_dest_prefix(const char *arg, struct args_state *state) {
     if (state->dest_prefix != NULL) {
         dprintf(2, "Destination prefix image is already set\n");
@@ -79,6 +142,271 @@ static int parse_base(const char *arg, struct args_state *state) {
         dprintf(2, "Provided base is not supported (try \"fourier\", \"legendre\" or \"heaviside\")\n");
         return -1;
     }
+    state->base_name = arg;
+    return 0;
+}
+
+static struct points_list *complete_cycle(const struct points_list *pl, const struct args_state *args) {
+    return short_cycle(pl);
+}
+
+static struct points_list *knn_cycle(const struct points_list *pl, const struct args_state *args) {
+    return sparse_short_cycle(pl, args->neighbours);
+}
+
+static struct points_list *boruvka_cycle(const struct points_list *pl, const struct args_state *args) {
+    return parallel_short_cycle(pl, args->threads);
+}
+
+static struct points_list *hilbert_order_cycle(const struct points_list *pl, const struct args_state *args) {
+    return hilbert_cycle(pl);
+}
+
+static struct points_list *stroke_walk_cycle(const struct points_list *pl, const struct args_state *args) {
+    return stroke_cycle(pl);
+}
+
+static int parse_cycle(const char *arg, struct args_state *state) {
+    if (state->cycle != NULL) {
+        dprintf(2, "Cycle builder is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (cycle)\n");
+        return -1;
+    }
+    if (strcmp(arg, "complete") == 0) {
+        state->cycle = complete_cycle;
+    } else if (strcmp(arg, "knn") == 0) {
+        state->cycle = knn_cycle;
+    } else if (strcmp(arg, "boruvka") == 0) {
+        state->cycle = boruvka_cycle;
+    } else if (strcmp(arg, "hilbert") == 0) {
+        state->cycle = hilbert_order_cycle;
+    } else if (strcmp(arg, "stroke") == 0) {
+        state->cycle = stroke_walk_cycle;
+    } else {
+        dprintf(2, "Provided cycle builder is not supported (try \"complete\", \"knn\", \"boruvka\", \"hilbert\" or \"stroke\")\n");
+        return -1;
+    }
+    state->cycle_name = arg;
+    return 0;
+}
+
+static int parse_neighbours(const char *arg, struct args_state *state) {
+    if (state->neighbours_set) {
+        dprintf(2, "Number of neighbours is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (neighbours)\n");
+        return -1;
+    }
+    char *end = NULL;
+    state->neighbours = strtoull(arg, &end, 0);
+    if (*end != '\0') {
+        dprintf(2, "Cannot parse number of neighbours\n");
+        return -1;
+    }
+    state->neighbours_set = 1;
+    return 0;
+}
+
+static int parse_threads(const char *arg, struct args_state *state) {
+    if (state->threads_set) {
+        dprintf(2, "Number of threads is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (threads)\n");
+        return -1;
+    }
+    char *end = NULL;
+    state->threads = strtoull(arg, &end, 0);
+    if (*end != '\0') {
+        dprintf(2, "Cannot parse number of threads\n");
+        return -1;
+    }
+    state->threads_set = 1;
+    return 0;
+}
+
+static int parse_cycle_budget(const char *arg, struct args_state *state) {
+    if (state->cycle_budget_set) {
+        dprintf(2, "Cycle budget is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (cycle_budget)\n");
+        return -1;
+    }
+    char *end = NULL;
+    state->cycle_budget = strtod(arg, &end);
+    if (*end != '\0') {
+        dprintf(2, "Cannot parse cycle budget\n");
+        return -1;
+    }
+    state->cycle_budget_set = 1;
+    return 0;
+}
+
+static int draw_points(struct raw_bitmap *bm, struct split sp, const struct raw_bitmap_info *rbi) {
+    struct points_list *pl = merge_doubles_list(sp, rbi->width, rbi->height);
+    if (pl == NULL) {
+        dprintf(2, "Cannot merge back the doubles_list into a sequence of points\n");
+        return -1;
+    }
+    int r = draw_points_list(bm, pl, 1);
+    destroy_points_list(pl);
+    return r;
+}
+
+static int draw_lines(struct raw_bitmap *bm, struct split sp, const struct raw_bitmap_info *rbi) {
+    return draw_polyline(bm, sp.dlx, sp.dly, 1);
+}
+
+static int parse_draw(const char *arg, struct args_state *state) {
+    if (state->draw != NULL) {
+        dprintf(2, "Drawing mode is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (draw)\n");
+        return -1;
+    }
+    if (strcmp(arg, "points") == 0) {
+        state->draw = draw_points;
+    } else if (strcmp(arg, "lines") == 0) {
+        state->draw = draw_lines;
+    } else {
+        dprintf(2, "Provided drawing mode is not supported (try \"points\" or \"lines\")\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_samples(const char *arg, struct args_state *state) {
+    if (state->samples_set) {
+        dprintf(2, "Number of samples is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (samples)\n");
+        return -1;
+    }
+    char *end = NULL;
+    state->samples = strtoull(arg, &end, 0);
+    if (*end != '\0') {
+        dprintf(2, "Cannot parse number of samples\n");
+        return -1;
+    }
+    state->samples_set = 1;
+    return 0;
+}
+
+/* Pictures are written as numbered BMP files unless streamed */
+#define OUTPUT_BMP -1
+
+static int parse_output(const char *arg, struct args_state *state) {
+    if (state->output_set) {
+        dprintf(2, "Output format is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (output)\n");
+        return -1;
+    }
+    if (strcmp(arg, "bmp") == 0) {
+        state->output = OUTPUT_BMP;
+    } else if (strcmp(arg, "y4m") == 0) {
+        state->output = BITMAP_STREAM_Y4M;
+    } else if (strcmp(arg, "gray") == 0) {
+        state->output = BITMAP_STREAM_GRAY;
+    } else if (strcmp(arg, "delta") == 0) {
+        state->output = BITMAP_STREAM_DELTA;
+    } else {
+        dprintf(2, "Provided output format is not supported (try \"bmp\", \"y4m\", \"gray\" or \"delta\")\n");
+        return -1;
+    }
+    state->output_set = 1;
+    return 0;
+}
+
+static int parse_stream(const char *arg, struct args_state *state) {
+    if (state->stream != NULL) {
+        dprintf(2, "Stream is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (stream)\n");
+        return -1;
+    }
+    state->stream = arg;
+    return 0;
+}
+
+static int parse_cache_dir(const char *arg, struct args_state *state) {
+    if (state->cache_dir != NULL) {
+        dprintf(2, "Cache directory is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (cache_dir)\n");
+        return -1;
+    }
+    state->cache_dir = arg;
+    return 0;
+}
+
+static int parse_rle(const char *arg, struct args_state *state) {
+    if (state->rle_set) {
+        dprintf(2, "Run length encoding is already set\n");
+        return -1;
+    }
+    if (arg != NULL) {
+        dprintf(2, "Unexpected parameter (rle)\n");
+        return -1;
+    }
+    state->rle_set = 1;
+    return 0;
+}
+
+static int parse_quiet(const char *arg, struct args_state *state) {
+    if (state->quiet_set) {
+        dprintf(2, "Quiet is already set\n");
+        return -1;
+    }
+    if (arg != NULL) {
+        dprintf(2, "Unexpected parameter (quiet)\n");
+        return -1;
+    }
+    state->quiet_set = 1;
+    return 0;
+}
+
+static int parse_report(const char *arg, struct args_state *state) {
+    if (state->report != NULL) {
+        dprintf(2, "Report is already set\n");
+        return -1;
+    }
+    if (arg == NULL) {
+        dprintf(2, "Missing parameter (report)\n");
+        return -1;
+    }
+    state->report = arg;
+    return 0;
+}
+
+static int parse_perf(const char *arg, struct args_state *state) {
+    if (state->perf_set) {
+        dprintf(2, "Hardware counters are already set\n");
+        return -1;
+    }
+    if (arg != NULL) {
+        dprintf(2, "Unexpected parameter (perf)\n");
+        return -1;
+    }
+    state->perf_set = 1;
     return 0;
 }
 
@@ -259,10 +587,24 @@ static struct option options[] = {
     {
         .arg_name = "source",
         .parameter_name = "file_name",
-        .description = "<file_name> must be a non-compressed bitmap file with data to proces",
+        .description = "<file_name> must be a bitmap file with data to proces, unless --batch is given",
         .parse = parse_source,
         .deflt = NULL,
     },
+    {
+        .arg_name = "batch",
+        .parameter_name = "path",
+        .description = "<path> is either a directory, whose .bmp files are all processed, or a file listing one source per line; the images share the --threads workers, pictures being named after each source",
+        .parse = parse_batch,
+        .deflt = "none",
+    },
+    {
+        .arg_name = "serve",
+        .parameter_name = "socket",
+        .description = "<socket> is a Unix socket path on which jobs are served until SIGINT or SIGTERM, by --threads threads keeping the analyses in memory (see LisezMoi.md for the protocol)",
+        .parse = parse_serve,
+        .deflt = "none",
+    },
     {
         .arg_name = "destination_prefix",
         .parameter_name = "file_name_prefix",
@@ -277,6 +619,97 @@ static struct option options[] = {
         .parse = parse_base,
         .deflt = "fourier",
     },
+    {
+        .arg_name = "cycle",
+        .parameter_name = "builder",
+        .description = "<builder> must be either \"complete\" (tree over all pairs of points), \"knn\" (tree over nearest neighbours), \"boruvka\" (same tree as \"complete\", built by threads), \"hilbert\" (points sorted along a Hilbert curve, fast but longer) or \"stroke\" (walk along the strokes of 1 pixel wide drawings)",
+        .parse = parse_cycle,
+        .deflt = "complete",
+    },
+    {
+        .arg_name = "neighbours",
+        .parameter_name = "k",
+        .description = "<k> is the number of nearest neighbours linked to each point by the \"knn\" builder and tried by the cycle shortening",
+        .parse = parse_neighbours,
+        .deflt = "8",
+    },
+    {
+        .arg_name = "threads",
+        .parameter_name = "n",
+        .description = "<n> is the number of threads used by the \"boruvka\" builder and to render pictures in parallel",
+        .parse = parse_threads,
+        .deflt = "1",
+    },
+    {
+        .arg_name = "cycle_budget",
+        .parameter_name = "seconds",
+        .description = "<seconds> is the time spent shortening the cycle by local moves, 0 keeps the cycle as built",
+        .parse = parse_cycle_budget,
+        .deflt = "0",
+    },
+    {
+        .arg_name = "draw",
+        .parameter_name = "mode",
+        .description = "<mode> must be either \"points\" (one pixel per sample) or \"lines\" (samples joined by segments)",
+        .parse = parse_draw,
+        .deflt = "points",
+    },
+    {
+        .arg_name = "samples",
+        .parameter_name = "n",
+        .description = "<n> is the number of points rebuilt per picture, 0 stands for the length of the cycle",
+        .parse = parse_samples,
+        .deflt = "0",
+    },
+    {
+        .arg_name = "output",
+        .parameter_name = "format",
+        .description = "<format> must be either \"bmp\" (one file per picture), \"y4m\" (YUV4MPEG2 video), \"gray\" (raw 8 bits frames) or \"delta\" (changes from frame to frame, see delta_to_bmp)",
+        .parse = parse_output,
+        .deflt = "bmp",
+    },
+    {
+        .arg_name = "stream",
+        .parameter_name = "file_name",
+        .description = "<file_name> receives the \"y4m\", \"gray\" and \"delta\" outputs, \"-\" being the standard output",
+        .parse = parse_stream,
+        .deflt = "-",
+    },
+    {
+        .arg_name = "cache_dir",
+        .parameter_name = "directory",
+        .description = "<directory> keeps the cycle and the coefficients of each analysed image, keyed by its pixels, base, cycle and scaling options, so that later runs skip straight to the pictures",
+        .parse = parse_cache_dir,
+        .deflt = "none",
+    },
+    {
+        .arg_name = "rle",
+        .parameter_name = NULL,
+        .description = "stores the \"bmp\" pictures run length encoded (RLE4, or RLE8 above 16 colors)",
+        .parse = parse_rle,
+        .deflt = NULL,
+    },
+    {
+        .arg_name = "quiet",
+        .parameter_name = NULL,
+        .description = "leaves out the progress messages, errors being still printed",
+        .parse = parse_quiet,
+        .deflt = NULL,
+    },
+    {
+        .arg_name = "report",
+        .parameter_name = "file_name",
+        .description = "<file_name> receives the wall and CPU time and item count of each stage (load, points extraction, cycle, split, homothetie, analysis) and of the reconstruction, rasterisation and writing of each picture, with the peak memory and the heap growth of the whole run only (the heap being shared by all threads), as CSV if it ends with \".csv\", as JSON otherwise",
+        .parse = parse_report,
+        .deflt = "none",
+    },
+    {
+        .arg_name = "perf",
+        .parameter_name = NULL,
+        .description = "adds the CPU cycles, instructions and cache misses of each stage to the --report, when perf_event_open is allowed",
+        .parse = parse_perf,
+        .deflt = NULL,
+    },
     {
         .arg_name = "starting_mode",
         .parameter_name = "mode",
@@ -421,7 +854,12 @@ static int parse_args(struct args_state *args, int argc, char **argv) {
 }
 
 static int set_deflts(struct args_state *args) {
-    if (args->source == NULL) {
+    if ((args->batch != NULL) || (args->serve != NULL)) {
+        if ((args->source != NULL) || (args->dest_prefix != NULL) || ((args->batch != NULL) && (args->serve != NULL))) {
+            dprintf(2, "Sources and destinations are given by the batch or by the jobs\n");
+            return -1;
+        }
+    } else if (args->source == NULL) {
         dprintf(2, "Missing source\n");
         return -1;
     }
@@ -430,6 +868,37 @@ static int set_deflts(struct args_state *args) {
     }
     if (args->base == NULL) {
         args->base = fourier;
+        args->base_name = "fourier";
+    }
+    if (args->cycle == NULL) {
+        args->cycle = complete_cycle;
+        args->cycle_name = "complete";
+    }
+    if (args->neighbours_set == 0) {
+        args->neighbours = 8;
+        args->neighbours_set = 1;
+    }
+    if (args->threads_set == 0) {
+        args->threads = 1;
+        args->threads_set = 1;
+    }
+    if (args->cycle_budget_set == 0) {
+        args->cycle_budget = 0.0;
+        args->cycle_budget_set = 1;
+    }
+    if (args->draw == NULL) {
+        args->draw = draw_points;
+    }
+    if (args->samples_set == 0) {
+        args->samples = 0;
+        args->samples_set = 1;
+    }
+    if (args->output_set == 0) {
+        args->output = OUTPUT_BMP;
+        args->output_set = 1;
+    }
+    if (args->stream == NULL) {
+        args->stream = "-";
     }
     if (args->starting_mode_set == 0) {
         args->starting_mode = 0;
@@ -466,72 +935,224 @@ static int set_deflts(struct args_state *args) {
     return 0;
 }
 
-int main(int argc, char **argv) {
-    struct args_state args = { 0 };
+/* Last mode of picture k, the modes added per picture growing by mode_quad each time */
+static size_t picture_mode(const struct args_state *args, size_t k) {
+    return args->starting_mode + k * args->mode_increment + args->mode_quad * (k * (k - 1) / 2);
+}
+
+#define FRAME_PENDING 0
+#define FRAME_READY 1
+#define FRAME_FAILED 2
+
+struct frame_slot {
+    struct raw_bitmap *bm;
+    int state;
+};
+
+/*
+ * Pictures are independent tasks: with several workers, each one rebuilds its
+ * samples from the read-only coefficients and plan, so that a picture does not
+ * depend on the thread drawing it. A single worker draws them in order and
+ * only adds the new modes of each picture. The main thread hands them over in
+ * order, at most window pictures being drawn ahead of it.
+ */
+struct frame_pool {
+    const struct args_state *args;
+    struct raw_bitmap_info rbi;
+    const struct doubles_list *sx;
+    const struct doubles_list *sy;
+    const struct fft_plan *plan;
+    size_t samples;
+    _Bool incremental;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t room;
+    size_t next;
+    size_t emitted;
+    size_t window;
+    _Bool stop;
+    struct frame_slot slots[];
+};
+
+#define NO_MODE SIZE_MAX
+
+/* sp holds the sum of the modes up to *summed (NO_MODE when empty), those of picture k are added to it; summed is NULL to rebuild it */
+static struct raw_bitmap *render_frame(const struct args_state *args, const struct raw_bitmap_info *rbi, const struct doubles_list *sx, const struct doubles_list *sy, const struct fft_plan *plan, struct split sp, size_t k, size_t *summed) {
+    size_t cmode = picture_mode(args, k);
+    note("---- iteration %zu ------------\n", k);
+    struct probe p;
+    probe_begin(&p, PROBE_RECONSTRUCT, k);
     int r;
-    r = parse_args(&args, argc, argv);
-    if (r != 0) {
-        args.help_set = 1;
+    if ((summed != NULL) && (*summed != NO_MODE) && (*summed <= cmode)) {
+        r = add_base_vectors(sp.dlx, args->base, sx, plan, *summed + 1, cmode);
+        if (r == 0) {
+            r = add_base_vectors(sp.dly, args->base, sy, plan, *summed + 1, cmode);
+        }
+    } else {
+        r = rebuild_from_coefficients(sp.dlx, args->base, sx, plan, cmode);
+        if (r == 0) {
+            r = rebuild_from_coefficients(sp.dly, args->base, sy, plan, cmode);
+        }
     }
-    r = set_deflts(&args);
-    if (r != 0) {
-        args.help_set = 1;
+    if (summed != NULL) {
+        *summed = (r == 0) ? cmode : NO_MODE;
     }
+    probe_end(&p, 2 * get_doubles_num(sp.dlx));
+    if (r != 0) {
+        dprintf(2, "Cannot add the new modes\n");
+        return NULL;
+    }
+    struct raw_bitmap *bm = create_raw_bitmap(*rbi);
+    if (bm == NULL) {
+        dprintf(2, "Cannot create an empty bitmap\n");
+        return NULL;
+    }
+    struct rgba k0 = {
+        .a = 0,
+        .r = 0,
+        .g = 0,
+        .b = 0,
+    };
+    struct rgba k1 = {
+        .b = 255,
+        .g = 255,
+        .r = 255,
+        .a = 0,
+    };
+    (void)set_color(bm, 0, k0);
+    (void)set_color(bm, 1, k1);
+    probe_begin(&p, PROBE_RASTERISE, k);
+    r = args->draw(bm, sp, rbi);
+    probe_end(&p, get_doubles_num(sp.dlx));
+    if (r < 0) {
+        dprintf(2, "Could not redraw\n");
+        destroy_raw_bitmap(bm);
+        return NULL;
+    }
+    note("Picture %zu redrawn in buffer with the exception of %d points out of %zu which are out of canvas\n", k, r, get_doubles_num(sp.dlx));
+    return bm;
+}
 
-    if (args.help_set) {
-        show_help(argv[0]);
-        return -1;
+static void *frame_worker(void *arg) {
+    struct frame_pool *fp = arg;
+    struct split sp = {
+        .dlx = create_doubles_list(fp->samples),
+        .dly = create_doubles_list(fp->samples),
+    };
+    size_t summed = NO_MODE;
+    pthread_mutex_lock(&fp->lock);
+    while (!fp->stop && (fp->next < fp->args->pictures)) {
+        size_t k = fp->next;
+        ++fp->next;
+        while (!fp->stop && (k >= fp->emitted + fp->window)) {
+            pthread_cond_wait(&fp->room, &fp->lock);
+        }
+        if (fp->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&fp->lock);
+        struct raw_bitmap *bm = ((sp.dlx != NULL) && (sp.dly != NULL)) ? render_frame(fp->args, &fp->rbi, fp->sx, fp->sy, fp->plan, sp, k, fp->incremental ? &summed : NULL) : NULL;
+        pthread_mutex_lock(&fp->lock);
+        struct frame_slot *slot = &fp->slots[k % fp->window];
+        slot->bm = bm;
+        slot->state = (bm != NULL) ? FRAME_READY : FRAME_FAILED;
+        pthread_cond_broadcast(&fp->ready);
+    }
+    pthread_mutex_unlock(&fp->lock);
+    destroy_doubles_list(sp.dlx);
+    destroy_doubles_list(sp.dly);
+    return NULL;
+}
+
+/* Waits for picture k, returns NULL if it could not be drawn */
+static struct raw_bitmap *next_frame(struct frame_pool *fp, size_t k) {
+    pthread_mutex_lock(&fp->lock);
+    struct frame_slot *slot = &fp->slots[k % fp->window];
+    while (slot->state == FRAME_PENDING) {
+        pthread_cond_wait(&fp->ready, &fp->lock);
+    }
+    struct raw_bitmap *bm = slot->bm;
+    slot->bm = NULL;
+    slot->state = FRAME_PENDING;
+    fp->emitted = k + 1;
+    pthread_cond_broadcast(&fp->room);
+    pthread_mutex_unlock(&fp->lock);
+    return bm;
+}
+
+/* Reads fname, or the file image held in data when fname is NULL */
+static struct raw_bitmap *load_bitmap(const char *fname, const uint8_t *data, size_t data_size) {
+    struct probe p;
+    probe_begin(&p, PROBE_LOAD, -1);
+    struct raw_bitmap *bm = (fname != NULL) ? disk_to_bitmap(fname) : memory_to_bitmap(data, data_size);
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    probe_end(&p, (size_t)rbi.width * rbi.height);
+    return bm;
+}
+
+/* Hash of the pixels and of the options the cycle and the coefficients depend on */
+static uint64_t analysis_key(const struct raw_bitmap *bm, const struct args_state *args) {
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    uint64_t h = ANALYSIS_HASH_SEED;
+    h = hash_bytes(h, &rbi.width, sizeof(rbi.width));
+    h = hash_bytes(h, &rbi.height, sizeof(rbi.height));
+    h = hash_bytes(h, &rbi.bits_per_pixel, sizeof(rbi.bits_per_pixel));
+    /* Rows are contiguous */
+    h = hash_bytes(h, get_row_bytes(bm, 0), get_row_bytes_num(bm) * rbi.height);
+    h = hash_bytes(h, args->base_name, strlen(args->base_name) + 1);
+    h = hash_bytes(h, args->cycle_name, strlen(args->cycle_name) + 1);
+    h = hash_bytes(h, &args->neighbours, sizeof(args->neighbours));
+    h = hash_bytes(h, &args->cycle_budget, sizeof(args->cycle_budget));
+    h = hash_bytes(h, &args->xscale, sizeof(args->xscale));
+    h = hash_bytes(h, &args->xshift, sizeof(args->xshift));
+    h = hash_bytes(h, &args->yscale, sizeof(args->yscale));
+    h = hash_bytes(h, &args->yshift, sizeof(args->yshift));
+    return h;
+}
+
+/* Orders the points of pl0, which is destroyed */
+static struct points_list *shape_cycle(struct points_list *pl0, const struct args_state *args) {
+    struct probe p;
+    probe_begin(&p, PROBE_CYCLE, -1);
+    struct points_list *pl1 = args->cycle(pl0, args);
+    destroy_points_list(pl0);
+    if ((pl1 != NULL) && (args->cycle_budget > 0.0)) {
+        struct points_list *pl2 = improve_cycle(pl1, args->neighbours, args->cycle_budget);
+        destroy_points_list(pl1);
+        if (pl2 == NULL) {
+            dprintf(2, "Could not shorten the cycle\n");
+            return NULL;
+        }
+        pl1 = pl2;
     }
-    size_t last_mode = args.pictures * (args.pictures * args.mode_quad + args.mode_increment) + args.starting_mode;
-    if (last_mode > 999999) {
-        dprintf(2, "Too many modes\n");
-        return -1;
-    }
-    static char file_name[256];
-    size_t len = strlen(args.source);
-    if (len < 4) {
-        dprintf(2, "File name is too short\n");
-        return -1;
-    }
-    if (strcmp(args.source + len - 4, ".bmp") != 0) {
-        dprintf(2, "File extension is not .bmp\n");
-        return -1;
-    }
-    if ((strlen(args.source) + 7) >= sizeof(file_name)) {
-        dprintf(2, "File name is too long\n");
-        return -1;
-    }
-    if (args.mode_increment == 0) {
-        dprintf(2, "The mode increment must be at least 1\n");
-        return -1;
-    }
-    struct raw_bitmap *bm0 = disk_to_bitmap(args.source);
-    if (bm0 == NULL) {
-        dprintf(2, "Failed to load bitmap image\n");
-        return -1;
+    probe_end(&p, get_points_num(pl1));
+    if (pl1 == NULL) {
+        dprintf(2, "Could not compute a cycle for drawings\n");
+        return NULL;
     }
-    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm0);
-    dprintf(2, "Successfully loaded the bitmap image\n");
+    note("Cycle is computed\n");
+    return pl1;
+}
 
+static struct points_list *build_cycle(const struct raw_bitmap *bm0, const struct args_state *args) {
+    struct probe p;
+    probe_begin(&p, PROBE_EXTRACT, -1);
     struct points_list *pl0 = get_points_list(bm0, 1);
-    destroy_raw_bitmap(bm0);
+    probe_end(&p, get_points_num(pl0));
     if (pl0 == NULL) {
         dprintf(2, "Could not extract the list of points from the bitmap\n");
-        return -1;
+        return NULL;
     }
-    dprintf(2, "Extracted list of points\n");
-
-    struct points_list *pl1 = short_cycle(pl0);
-    destroy_points_list(pl0);
-    if (pl1 == NULL) {
-        dprintf(2, "Could not compute a cycle for drawings\n");
-        return -1;
-    }
-    size_t cycle_length = get_points_num(pl1);
-    dprintf(2, "Cycle is computed\n");
+    note("Extracted list of points\n");
+    return shape_cycle(pl0, args);
+}
 
-    struct split sp = split_points_list(pl1, rbi.width, rbi.height);
-    destroy_points_list(pl1);
+static int compute_coefficients(struct points_list *pl1, const struct raw_bitmap_info *rbi, const struct args_state *args, size_t modes, struct doubles_list **psx, struct doubles_list **psy) {
+    size_t points = get_points_num(pl1);
+    struct probe p;
+    probe_begin(&p, PROBE_SPLIT, -1);
+    struct split sp = split_points_list(pl1, rbi->width, rbi->height);
+    probe_end(&p, points);
     if (sp.dlx == NULL) {
         destroy_doubles_list(sp.dly);
         dprintf(2, "Cannot extract the X sequence\n");
@@ -542,9 +1163,11 @@ int main(int argc, char **argv) {
         dprintf(2, "Cannot extract the Y sequence\n");
         return -1;
     }
-    dprintf(2, "X and Y sequences extracted\n");
+    note("X and Y sequences extracted\n");
 
-    struct doubles_list *dlx = homothetie(sp.dlx, args.xscale, args.xshift);
+    probe_begin(&p, PROBE_HOMOTHETIE, -1);
+    struct doubles_list *dlx = homothetie(sp.dlx, args->xscale, args->xshift);
+    probe_end(&p, points);
     destroy_doubles_list(sp.dlx);
     sp.dlx = dlx;
     if (sp.dlx == NULL) {
@@ -552,9 +1175,11 @@ int main(int argc, char **argv) {
         destroy_doubles_list(sp.dly);
         return -1;
     }
-    dprintf(2, "X coordinates rescaled and shifted\n");
+    note("X coordinates rescaled and shifted\n");
 
-    struct doubles_list *dly = homothetie(sp.dly, args.yscale, args.yshift);
+    probe_begin(&p, PROBE_HOMOTHETIE, -1);
+    struct doubles_list *dly = homothetie(sp.dly, args->yscale, args->yshift);
+    probe_end(&p, points);
     destroy_doubles_list(sp.dly);
     sp.dly = dly;
     if (sp.dly == NULL) {
@@ -562,9 +1187,9 @@ int main(int argc, char **argv) {
         destroy_doubles_list(sp.dlx);
         return -1;
     }
-    dprintf(2, "Y coordinates rescaled and shifted\n");
+    note("Y coordinates rescaled and shifted\n");
 
-    struct doubles_list *sx = create_doubles_list(last_mode + 1);
+    struct doubles_list *sx = create_doubles_list(modes);
     if (sx == NULL) {
         dprintf(2, "Cannot create the X doubles_list\n");
         destroy_doubles_list(sp.dlx);
@@ -572,112 +1197,1041 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    struct doubles_list *sy = create_doubles_list(last_mode + 1);
-    if (sx == NULL) {
+    struct doubles_list *sy = create_doubles_list(modes);
+    if (sy == NULL) {
         dprintf(2, "Cannot create the Y doubles_list\n");
         destroy_doubles_list(sx);
+        destroy_doubles_list(sp.dlx);
         destroy_doubles_list(sp.dly);
         return -1;
     }
 
-    for (size_t i = 0; i < (last_mode + 1); ++i) {
-        double kx = scalar_product(sp.dlx, args.base, i);
-        set_double_from_doubles_list(sx, i, kx);
-        double ky = scalar_product(sp.dly, args.base, i);
-        set_double_from_doubles_list(sy, i, ky);
+    probe_begin(&p, PROBE_ANALYSIS, -1);
+    int r = base_coefficients(sp.dlx, args->base, sx);
+    if (r == 0) {
+        r = base_coefficients(sp.dly, args->base, sy);
     }
+    probe_end(&p, 2 * modes);
     destroy_doubles_list(sp.dlx);
     destroy_doubles_list(sp.dly);
-
-    sp.dlx = create_doubles_list(cycle_length);
-    if (sp.dlx == NULL) {
+    if (r != 0) {
+        dprintf(2, "Cannot compute the coefficients\n");
         destroy_doubles_list(sx);
         destroy_doubles_list(sy);
-        dprintf(2, "Cannot initialize new X points\n");
         return -1;
     }
-    sp.dly = create_doubles_list(cycle_length);
-    if (sp.dly == NULL) {
-        destroy_doubles_list(sp.dlx);
-        destroy_doubles_list(sx);
-        destroy_doubles_list(sy);
-        dprintf(2, "Cannot initialize new Y points\n");
-        return -1;
+    *psx = sx;
+    *psy = sy;
+    return 0;
+}
+
+/* Cache file of the analysis keyed by key, NULL without a cache directory */
+static char *cache_file_name(const struct args_state *args, uint64_t key) {
+    if (args->cache_dir == NULL) {
+        return NULL;
+    }
+    size_t name_size = strlen(args->cache_dir) + 24;
+    char *name = malloc(name_size);
+    if (name != NULL) {
+        (void)snprintf(name, name_size, "%s/%016" PRIx64 ".mfc", args->cache_dir, key);
     }
+    return name;
+}
 
-    int ret = 0;
-    size_t omode = 0;
-    size_t cmode = args.starting_mode;
-    for (size_t k = 0; k < args.pictures; ++k) {
-        dprintf(2, "---- iteration %zu ------------\n", k);
+/*
+ * Batch mode: every image goes through the stages below on a pool of
+ * args->threads workers shared by all the images, later stages being served
+ * first. At most capacity images wait for each stage, so that only a few of
+ * them are in memory at a time. Pictures are handed over to a bitmap_writer,
+ * which is the writing stage.
+ */
+#define STAGE_LOAD 0
+#define STAGE_EXTRACT 1
+#define STAGE_CYCLE 2
+#define STAGE_ANALYSE 3
+#define STAGE_RENDER 4
+#define STAGES 5
 
-        for (size_t u = omode; u <= cmode; ++u) {
-            double k;
-            k = get_double_from_doubles_list(sx, u);
-            add_base_vector(sp.dlx, args.base, u, k);
-            k = get_double_from_doubles_list(sy, u);
-            add_base_vector(sp.dly, args.base, u, k);
+struct batch_job {
+    const char *source;
+    struct raw_bitmap *bm;
+    struct raw_bitmap_info rbi;
+    uint64_t key;
+    char *cache_name;
+    struct points_list *pl;
+    _Bool cycled;
+    struct doubles_list *sx;
+    struct doubles_list *sy;
+    struct batch_job *next;
+};
+
+struct batch {
+    const struct args_state *args;
+    size_t last_mode;
+    struct bitmap_writer *writer;
+    char **sources;
+    size_t sources_num;
+    size_t admitted;
+    size_t active;
+    size_t failed;
+    size_t capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct batch_job *head[STAGES];
+    struct batch_job *tail[STAGES];
+    /* Jobs waiting for a stage, or bound to it once the previous one is over */
+    size_t slots[STAGES];
+};
+
+static void destroy_batch_job(struct batch_job *job) {
+    destroy_raw_bitmap(job->bm);
+    free(job->cache_name);
+    destroy_points_list(job->pl);
+    destroy_doubles_list(job->sx);
+    destroy_doubles_list(job->sy);
+    free(job);
+    return;
+}
+
+static int render_batch_job(const struct batch *b, struct batch_job *job) {
+    const struct args_state *args = b->args;
+    size_t len = strlen(job->source);
+    size_t name_size = len + 16;
+    char *name = malloc(name_size);
+    size_t samples = (args->samples > 0) ? args->samples : get_points_num(job->pl);
+    struct split sp = {
+        .dlx = create_doubles_list(samples),
+        .dly = create_doubles_list(samples),
+    };
+    struct fft_plan *plan = (args->base == fourier) ? create_fft_plan(samples) : NULL;
+    int r = ((name != NULL) && (sp.dlx != NULL) && (sp.dly != NULL) && ((plan != NULL) || (args->base != fourier))) ? 0 : -1;
+    /* One worker draws all the pictures of the job, in order */
+    size_t summed = NO_MODE;
+    for (size_t k = 0; (r == 0) && (k < args->pictures); ++k) {
+        struct raw_bitmap *bm = render_frame(args, &job->rbi, job->sx, job->sy, plan, sp, k, &summed);
+        if (bm == NULL) {
+            r = -1;
+            break;
         }
+        (void)snprintf(name, name_size, "%.*s_%06zu.bmp", (int)(len - 4), job->source, picture_mode(args, k));
+        r = queue_bitmap(b->writer, bm, name);
+    }
+    free(name);
+    destroy_doubles_list(sp.dlx);
+    destroy_doubles_list(sp.dly);
+    destroy_fft_plan(plan);
+    return r;
+}
 
-        struct points_list *pl2 = merge_doubles_list(sp, rbi.width, rbi.height);
-        if (pl2 == NULL) {
-            dprintf(2, "Cannot merge back the doubles_list into a sequence of points\n");
+static int run_stage(const struct batch *b, struct batch_job *job, int stage) {
+    const struct args_state *args = b->args;
+    switch (stage) {
+        case STAGE_LOAD:
+            job->bm = load_bitmap(job->source, NULL, 0);
+            if (job->bm == NULL) {
+                return -1;
+            }
+            job->rbi = get_raw_bitmap_info(job->bm);
+            if (args->cache_dir != NULL) {
+                job->key = analysis_key(job->bm, args);
+                job->cache_name = cache_file_name(args, job->key);
+                if ((job->cache_name != NULL) && (load_analysis(job->cache_name, job->key, b->last_mode + 1, &job->pl, &job->sx, &job->sy) == 0)) {
+                    job->cycled = 1;
+                }
+            }
+            return 0;
+        case STAGE_EXTRACT:
+            if (!job->cycled) {
+                struct probe p;
+                probe_begin(&p, PROBE_EXTRACT, -1);
+                job->pl = get_points_list(job->bm, 1);
+                probe_end(&p, get_points_num(job->pl));
+            }
+            destroy_raw_bitmap(job->bm);
+            job->bm = NULL;
+            if (job->pl == NULL) {
+                dprintf(2, "Could not extract the list of points from %s\n", job->source);
+                return -1;
+            }
+            return 0;
+        case STAGE_CYCLE:
+            if (!job->cycled) {
+                job->pl = shape_cycle(job->pl, args);
+                job->cycled = 1;
+            }
+            return (job->pl != NULL) ? 0 : -1;
+        case STAGE_ANALYSE:
+            if (job->sx != NULL) {
+                return 0;
+            }
+            if (compute_coefficients(job->pl, &job->rbi, args, b->last_mode + 1, &job->sx, &job->sy) != 0) {
+                return -1;
+            }
+            if ((job->cache_name != NULL) && (store_analysis(job->cache_name, job->key, job->pl, job->sx, job->sy) != 0)) {
+                dprintf(2, "Cannot update the cache\n");
+            }
+            return 0;
+        case STAGE_RENDER:
+            return render_batch_job(b, job);
+        default:
+            return -1;
+    }
+}
+
+static void *batch_worker(void *arg) {
+    struct batch *b = arg;
+    pthread_mutex_lock(&b->lock);
+    while (1) {
+        while ((b->admitted < b->sources_num) && (b->slots[STAGE_LOAD] < b->capacity)) {
+            struct batch_job *job = calloc(1, sizeof(*job));
+            ++b->admitted;
+            if (job == NULL) {
+                dprintf(2, "%s could not be processed\n", b->sources[b->admitted - 1]);
+                ++b->failed;
+                continue;
+            }
+            job->source = b->sources[b->admitted - 1];
+            ++b->active;
+            ++b->slots[STAGE_LOAD];
+            if (b->tail[STAGE_LOAD] != NULL) {
+                b->tail[STAGE_LOAD]->next = job;
+            } else {
+                b->head[STAGE_LOAD] = job;
+            }
+            b->tail[STAGE_LOAD] = job;
+        }
+        int stage = STAGES - 1;
+        while ((stage >= 0) && ((b->head[stage] == NULL) || ((stage + 1 < STAGES) && (b->slots[stage + 1] >= b->capacity)))) {
+            --stage;
+        }
+        if (stage < 0) {
+            if ((b->admitted == b->sources_num) && (b->active == 0)) {
+                break;
+            }
+            pthread_cond_wait(&b->changed, &b->lock);
+            continue;
+        }
+        struct batch_job *job = b->head[stage];
+        b->head[stage] = job->next;
+        if (b->head[stage] == NULL) {
+            b->tail[stage] = NULL;
+        }
+        job->next = NULL;
+        --b->slots[stage];
+        if (stage + 1 < STAGES) {
+            ++b->slots[stage + 1];
+        }
+        pthread_mutex_unlock(&b->lock);
+        int r = run_stage(b, job, stage);
+        pthread_mutex_lock(&b->lock);
+        if ((r != 0) || (stage + 1 == STAGES)) {
+            if (stage + 1 < STAGES) {
+                --b->slots[stage + 1];
+            }
+            if (r != 0) {
+                dprintf(2, "%s could not be processed\n", job->source);
+                ++b->failed;
+            } else {
+                note("%s fully processed\n", job->source);
+            }
+            destroy_batch_job(job);
+            --b->active;
+        } else {
+            if (b->tail[stage + 1] != NULL) {
+                b->tail[stage + 1]->next = job;
+            } else {
+                b->head[stage + 1] = job;
+            }
+            b->tail[stage + 1] = job;
+        }
+        pthread_cond_broadcast(&b->changed);
+    }
+    pthread_cond_broadcast(&b->changed);
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Pictures written by mini_fourier end with _NNNNNN.bmp, they are not taken as sources */
+static _Bool is_picture_name(const char *name) {
+    size_t len = strlen(name);
+    if ((len < 11) || (name[len - 11] != '_')) {
+        return 0;
+    }
+    for (size_t i = len - 10; i < len - 4; ++i) {
+        if ((name[i] < '0') || (name[i] > '9')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int add_source(char ***sources, size_t *num, size_t *allocated, char *source) {
+    if (source == NULL) {
+        return -1;
+    }
+    if (*num == *allocated) {
+        size_t n = (*allocated > 0) ? 2 * *allocated : 16;
+        char **s = realloc(*sources, n * sizeof(*s));
+        if (s == NULL) {
+            free(source);
+            return -1;
+        }
+        *sources = s;
+        *allocated = n;
+    }
+    (*sources)[*num] = source;
+    ++*num;
+    return 0;
+}
+
+/* The .bmp files of a directory (sorted by name), or the lines of a manifest (except empty ones and those starting with #) */
+static int list_sources(const char *path, char ***sources, size_t *num) {
+    *sources = NULL;
+    *num = 0;
+    size_t allocated = 0;
+    int r = 0;
+    DIR *dir = opendir(path);
+    if (dir != NULL) {
+        struct dirent *de;
+        while ((r == 0) && ((de = readdir(dir)) != NULL)) {
+            size_t len = strlen(de->d_name);
+            if ((len < 4) || (strcmp(de->d_name + len - 4, ".bmp") != 0) || is_picture_name(de->d_name)) {
+                continue;
+            }
+            size_t size = strlen(path) + len + 2;
+            char *source = malloc(size);
+            if (source != NULL) {
+                (void)snprintf(source, size, "%s/%s", path, de->d_name);
+            }
+            r = add_source(sources, num, &allocated, source);
+        }
+        closedir(dir);
+        if (r == 0) {
+            qsort(*sources, *num, sizeof(**sources), compare_names);
+        }
+    } else {
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            dprintf(2, "Cannot open the batch %s (%s)\n", path, strerror(errno));
+            return -1;
+        }
+        char *line = NULL;
+        size_t line_size = 0;
+        ssize_t len;
+        while ((r == 0) && ((len = getline(&line, &line_size, f)) >= 0)) {
+            while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r'))) {
+                line[--len] = '\0';
+            }
+            if ((len == 0) || (line[0] == '#')) {
+                continue;
+            }
+            r = add_source(sources, num, &allocated, strdup(line));
+        }
+        free(line);
+        fclose(f);
+    }
+    if (r != 0) {
+        dprintf(2, "Cannot list the batch sources\n");
+    }
+    return r;
+}
+
+static int run_batch(const struct args_state *args, size_t last_mode) {
+    struct batch b = {
+        .args = args,
+        .last_mode = last_mode,
+        .capacity = args->threads,
+    };
+    int ret = list_sources(args->batch, &b.sources, &b.sources_num);
+    for (size_t i = 0; (ret == 0) && (i < b.sources_num); ++i) {
+        size_t len = strlen(b.sources[i]);
+        if ((len < 4) || (strcmp(b.sources[i] + len - 4, ".bmp") != 0)) {
+            dprintf(2, "%s: file extension is not .bmp\n", b.sources[i]);
             ret = -1;
-            break;
         }
-        
-        dprintf(2, "Sequence of points rebuilt\n");
-        
-        struct raw_bitmap *bm1 = create_raw_bitmap(rbi);
+    }
+    if (ret == 0) {
+        note("%zu images in the batch\n", b.sources_num);
+        b.writer = create_bitmap_writer(2 * args->threads, args->rle_set);
+        if (b.writer == NULL) {
+            dprintf(2, "Cannot open the output\n");
+            ret = -1;
+        }
+    }
+    pthread_t *workers = (ret == 0) ? malloc(args->threads * sizeof(*workers)) : NULL;
+    size_t started = 0;
+    if (workers != NULL) {
+        pthread_mutex_init(&b.lock, NULL);
+        pthread_cond_init(&b.changed, NULL);
+        while ((started < args->threads) && (pthread_create(&workers[started], NULL, batch_worker, &b) == 0)) {
+            ++started;
+        }
+        for (size_t j = 0; j < started; ++j) {
+            pthread_join(workers[j], NULL);
+        }
+        pthread_mutex_destroy(&b.lock);
+        pthread_cond_destroy(&b.changed);
+        free(workers);
+    }
+    if ((ret == 0) && (started == 0)) {
+        dprintf(2, "Cannot start the batch threads\n");
+        ret = -1;
+    }
+    if ((b.writer != NULL) && (destroy_bitmap_writer(b.writer) != 0)) {
+        dprintf(2, "Write error\n");
+        ret = -1;
+    }
+    if (b.failed > 0) {
+        dprintf(2, "%zu images out of %zu could not be processed\n", b.failed, b.sources_num);
+        ret = -1;
+    }
+    for (size_t i = 0; i < b.sources_num; ++i) {
+        free(b.sources[i]);
+    }
+    free(b.sources);
+    if (ret == 0) {
+        note("-- DONE --\n");
+    }
+    return ret;
+}
+
+/* Validates the options once defaults are set, and computes the last mode needed */
+static int check_args(const struct args_state *args, size_t *last_mode) {
+    *last_mode = args->pictures * (args->pictures * args->mode_quad + args->mode_increment) + args->starting_mode;
+    if (*last_mode > 999999) {
+        dprintf(2, "Too many modes\n");
+        return -1;
+    }
+    if (args->neighbours == 0) {
+        dprintf(2, "The knn builder needs at least 1 neighbour\n");
+        return -1;
+    }
+    if (args->threads == 0) {
+        dprintf(2, "At least 1 thread is needed\n");
+        return -1;
+    }
+    if (args->cycle_budget < 0.0) {
+        dprintf(2, "The cycle budget cannot be negative\n");
+        return -1;
+    }
+    if (args->mode_increment == 0) {
+        dprintf(2, "The mode increment must be at least 1\n");
+        return -1;
+    }
+    if (args->perf_set && (args->report == NULL)) {
+        dprintf(2, "Hardware counters are only written to a --report\n");
+        return -1;
+    }
+    if ((args->batch != NULL) && (args->output != OUTPUT_BMP)) {
+        dprintf(2, "Batches are only written as bmp pictures\n");
+        return -1;
+    }
+    return 0;
+}
+
+static struct raw_bitmap *load_source(const struct args_state *args) {
+    size_t len = strlen(args->source);
+    if (len < 4) {
+        dprintf(2, "File name is too short\n");
+        return NULL;
+    }
+    if (strcmp(args->source + len - 4, ".bmp") != 0) {
+        dprintf(2, "File extension is not .bmp\n");
+        return NULL;
+    }
+    struct raw_bitmap *bm0 = load_bitmap(args->source, NULL, 0);
+    if (bm0 == NULL) {
+        dprintf(2, "Failed to load bitmap image\n");
+        return NULL;
+    }
+    note("Successfully loaded the bitmap image\n");
+    return bm0;
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + 1e-9 * (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/* Coefficients of the latest analyses, kept in memory by the server */
+#define WARM_ENTRIES 16
+
+struct warm_entry {
+    uint64_t key;
+    size_t cycle_length;
+    struct doubles_list *sx;
+    struct doubles_list *sy;
+};
+
+struct warm_cache {
+    pthread_mutex_t lock;
+    size_t next;
+    struct warm_entry entries[WARM_ENTRIES];
+};
+
+static struct doubles_list *copy_doubles_list(const struct doubles_list *dl) {
+    struct doubles_list *copy = create_doubles_list(get_doubles_num(dl));
+    if (copy != NULL) {
+        memcpy(get_mutable_doubles_array(copy), get_doubles_array(dl), get_doubles_num(dl) * sizeof(double));
+    }
+    return copy;
+}
+
+/* Copies the coefficients of key when at least modes of them are known */
+static int warm_lookup(struct warm_cache *wc, uint64_t key, size_t modes, size_t *cycle_length, struct doubles_list **sx, struct doubles_list **sy) {
+    int r = -1;
+    pthread_mutex_lock(&wc->lock);
+    for (size_t i = 0; i < WARM_ENTRIES; ++i) {
+        struct warm_entry *e = &wc->entries[i];
+        if ((e->sx == NULL) || (e->key != key) || (get_doubles_num(e->sx) < modes)) {
+            continue;
+        }
+        *sx = copy_doubles_list(e->sx);
+        *sy = copy_doubles_list(e->sy);
+        if ((*sx != NULL) && (*sy != NULL)) {
+            *cycle_length = e->cycle_length;
+            r = 0;
+        } else {
+            destroy_doubles_list(*sx);
+            destroy_doubles_list(*sy);
+            *sx = NULL;
+            *sy = NULL;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&wc->lock);
+    return r;
+}
+
+static void warm_store(struct warm_cache *wc, uint64_t key, size_t cycle_length, const struct doubles_list *sx, const struct doubles_list *sy) {
+    struct doubles_list *cx = copy_doubles_list(sx);
+    struct doubles_list *cy = copy_doubles_list(sy);
+    if ((cx == NULL) || (cy == NULL)) {
+        destroy_doubles_list(cx);
+        destroy_doubles_list(cy);
+        return;
+    }
+    pthread_mutex_lock(&wc->lock);
+    size_t i = 0;
+    while ((i < WARM_ENTRIES) && ((wc->entries[i].sx == NULL) || (wc->entries[i].key != key))) {
+        ++i;
+    }
+    if (i == WARM_ENTRIES) {
+        i = wc->next;
+        wc->next = (wc->next + 1) % WARM_ENTRIES;
+    }
+    struct warm_entry *e = &wc->entries[i];
+    destroy_doubles_list(e->sx);
+    destroy_doubles_list(e->sy);
+    e->key = key;
+    e->cycle_length = cycle_length;
+    e->sx = cx;
+    e->sy = cy;
+    pthread_mutex_unlock(&wc->lock);
+    return;
+}
+
+/* Cycle length and coefficients of bm0 (which is destroyed), from the caches when possible */
+static int analyse_image(const struct args_state *args, size_t last_mode, struct raw_bitmap *bm0, struct warm_cache *warm, struct doubles_list **psx, struct doubles_list **psy, size_t *cycle_length) {
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm0);
+    uint64_t key = ((args->cache_dir != NULL) || (warm != NULL)) ? analysis_key(bm0, args) : 0;
+    if ((warm != NULL) && (warm_lookup(warm, key, last_mode + 1, cycle_length, psx, psy) == 0)) {
+        destroy_raw_bitmap(bm0);
+        note("Coefficients found in memory\n");
+        return 0;
+    }
+    char *cache_name = cache_file_name(args, key);
+    struct points_list *pl1 = NULL;
+    struct doubles_list *sx = NULL;
+    struct doubles_list *sy = NULL;
+    if ((cache_name != NULL) && (load_analysis(cache_name, key, last_mode + 1, &pl1, &sx, &sy) == 0)) {
+        note("Cycle %sread from %s\n", (sx != NULL) ? "and coefficients " : "", cache_name);
+    } else {
+        pl1 = build_cycle(bm0, args);
+    }
+    destroy_raw_bitmap(bm0);
+    if (pl1 == NULL) {
+        free(cache_name);
+        return -1;
+    }
+    *cycle_length = get_points_num(pl1);
+
+    int r = 0;
+    if (sx == NULL) {
+        r = compute_coefficients(pl1, &rbi, args, last_mode + 1, &sx, &sy);
+        if ((r == 0) && (cache_name != NULL) && (store_analysis(cache_name, key, pl1, sx, sy) != 0)) {
+            dprintf(2, "Cannot update the cache\n");
+        }
+    }
+    destroy_points_list(pl1);
+    free(cache_name);
+    if (r != 0) {
+        return -1;
+    }
+    if (warm != NULL) {
+        warm_store(warm, key, *cycle_length, sx, sy);
+    }
+    *psx = sx;
+    *psy = sy;
+    return 0;
+}
+
+/* Draws and writes the pictures on args->threads workers, *pictures counting those handed over to the output */
+static int render_image(const struct args_state *args, const struct raw_bitmap_info *rbi, const struct doubles_list *sx, const struct doubles_list *sy, size_t samples, size_t *pictures) {
+    *pictures = 0;
+    /* The default prefix is the source, without its extension */
+    size_t prefix_len = strlen(args->dest_prefix) - ((args->dest_prefix == args->source) ? 4 : 0);
+    size_t name_size = prefix_len + 16;
+    char *file_name = malloc(name_size);
+    struct bitmap_writer *writer = NULL;
+    struct bitmap_stream *stream = NULL;
+    if (args->output == OUTPUT_BMP) {
+        writer = create_bitmap_writer(2, args->rle_set);
+    } else {
+        stream = open_bitmap_stream(args->stream, args->output, rbi->width, rbi->height);
+    }
+    if ((file_name == NULL) || ((writer == NULL) && (stream == NULL))) {
+        free(file_name);
+        if (writer != NULL) {
+            (void)destroy_bitmap_writer(writer);
+        }
+        if (stream != NULL) {
+            (void)close_bitmap_stream(stream);
+        }
+        dprintf(2, "Cannot open the output\n");
+        return -1;
+    }
+
+    size_t window = 2 * args->threads;
+    struct frame_pool *fp = malloc(sizeof(*fp) + window * sizeof(struct frame_slot));
+    pthread_t *workers = malloc(args->threads * sizeof(*workers));
+    /* One plan for every picture, only read by the workers */
+    struct fft_plan *plan = (args->base == fourier) ? create_fft_plan(samples) : NULL;
+    _Bool pooled = (fp != NULL) && (workers != NULL) && ((plan != NULL) || (args->base != fourier));
+    size_t started = 0;
+    if (pooled) {
+        fp->args = args;
+        fp->rbi = *rbi;
+        fp->sx = sx;
+        fp->sy = sy;
+        fp->plan = plan;
+        fp->samples = samples;
+        fp->incremental = (args->threads == 1);
+        pthread_mutex_init(&fp->lock, NULL);
+        pthread_cond_init(&fp->ready, NULL);
+        pthread_cond_init(&fp->room, NULL);
+        fp->next = 0;
+        fp->emitted = 0;
+        fp->window = window;
+        fp->stop = 0;
+        for (size_t j = 0; j < window; ++j) {
+            fp->slots[j].bm = NULL;
+            fp->slots[j].state = FRAME_PENDING;
+        }
+        while ((started < args->threads) && (pthread_create(&workers[started], NULL, frame_worker, fp) == 0)) {
+            ++started;
+        }
+    }
+
+    int ret = 0;
+    int r;
+    if (started == 0) {
+        dprintf(2, "Cannot start the rendering threads\n");
+        ret = -1;
+    }
+    for (size_t k = 0; (ret == 0) && (k < args->pictures); ++k) {
+        struct raw_bitmap *bm1 = next_frame(fp, k);
         if (bm1 == NULL) {
-            dprintf(2, "Cannot create an empty bitmap\n");
-            destroy_points_list(pl2);
             ret = -1;
             break;
         }
-        struct rgba k0 = {
-            .a = 0,
-            .r = 0,
-            .g = 0,
-            .b = 0,
-        };
-        struct rgba k1 = {
-            .b = 255,
-            .g = 255,
-            .r = 255,
-            .a = 0,
-        };
-        (void)set_color(bm1, 0, k0);
-        (void)set_color(bm1, 1, k1);
-        dprintf(2, "Canvas prepared\n");
-        r = draw_points_list(bm1, pl2, 1);
-        destroy_points_list(pl2);
-        if (r < 0) {
-            dprintf(2, "Could not redraw\n");
+        if (stream != NULL) {
+            struct probe p;
+            probe_begin(&p, PROBE_WRITE, k);
+            r = stream_bitmap(stream, bm1, picture_mode(args, k));
+            probe_end(&p, (size_t)rbi->width * rbi->height);
             destroy_raw_bitmap(bm1);
-            ret = -1;
-            break;
+        } else {
+            (void)snprintf(file_name, name_size, "%.*s_%06zu.bmp", (int)prefix_len, args->dest_prefix, picture_mode(args, k));
+            r = queue_bitmap(writer, bm1, file_name);
         }
-        dprintf(2, "Picture redrawn in buffer with the exception of %d points out of %zu which are out of canvas\n", r, cycle_length);
-
-        (void)sprintf(file_name, "%.*s_%06zu.bmp", (int)(len - 4), args.dest_prefix, cmode);
-        r = bitmap_to_disk(bm1, file_name);
-        destroy_raw_bitmap(bm1);
         if (r != 0) {
             dprintf(2, "Write error\n");
             ret = -1;
             break;
         }
-        dprintf(2, "Image fully processed\n");
-        omode = cmode + 1;
-        cmode += args.mode_increment + k * args.mode_quad;
+        ++*pictures;
+        note("Image fully processed\n");
+    }
+    if (started > 0) {
+        pthread_mutex_lock(&fp->lock);
+        fp->stop = 1;
+        pthread_cond_broadcast(&fp->room);
+        pthread_mutex_unlock(&fp->lock);
+        for (size_t j = 0; j < started; ++j) {
+            pthread_join(workers[j], NULL);
+        }
+        for (size_t j = 0; j < window; ++j) {
+            destroy_raw_bitmap(fp->slots[j].bm);
+        }
     }
-    if (ret == 0) {
-        dprintf(2, "-- DONE --\n");
+    if (pooled) {
+        pthread_mutex_destroy(&fp->lock);
+        pthread_cond_destroy(&fp->ready);
+        pthread_cond_destroy(&fp->room);
+    }
+    free(workers);
+    free(fp);
+    destroy_fft_plan(plan);
+    free(file_name);
+    r = (stream != NULL) ? close_bitmap_stream(stream) : destroy_bitmap_writer(writer);
+    if ((r != 0) && (ret == 0)) {
+        dprintf(2, "Write error\n");
+        ret = -1;
+    }
+    return ret;
+}
+
+struct job_report {
+    size_t pictures;
+    double analysis_seconds;
+    double render_seconds;
+};
+
+/* Whole processing of one image, bm0 being destroyed */
+static int run_image(const struct args_state *args, size_t last_mode, struct raw_bitmap *bm0, struct warm_cache *warm, struct job_report *report) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm0);
+    struct doubles_list *sx = NULL;
+    struct doubles_list *sy = NULL;
+    size_t cycle_length = 0;
+    int r = analyse_image(args, last_mode, bm0, warm, &sx, &sy, &cycle_length);
+    report->analysis_seconds = elapsed_since(&start);
+    report->pictures = 0;
+    if (r == 0) {
+        size_t samples = (args->samples > 0) ? args->samples : cycle_length;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        r = render_image(args, &rbi, sx, sy, samples, &report->pictures);
+        report->render_seconds = elapsed_since(&start);
     }
-    destroy_doubles_list(sp.dly);
-    destroy_doubles_list(sp.dlx);
     destroy_doubles_list(sx);
     destroy_doubles_list(sy);
+    return r;
+}
+
+/*
+ * Server mode: jobs are read from a Unix socket, one per connection, by
+ * args->threads threads which stay up between jobs, and analyses are kept
+ * in memory from one job to the next. All integers are 32 bits little endian.
+ *
+ * Request: "MFJ1", the number of arguments, each argument (length, then its
+ * bytes), the size of an inline bitmap file (0 for none), then its bytes.
+ * Arguments are the command line options of a single image.
+ *
+ * Reply: "MFR1", the status (0 on success), the number of pictures written,
+ * the analysis, rendering and total times in microseconds, then a message
+ * (length, then its bytes).
+ *
+ * A client silent for SERVE_TIMEOUT_SECONDS while its request is read, or
+ * not reading its reply, gets the request dropped as malformed, so that it
+ * cannot hold a worker forever.
+ */
+#define SERVE_REQUEST_MAGIC "MFJ1"
+#define SERVE_REPLY_MAGIC "MFR1"
+#define SERVE_MAX_ARGS 64
+#define SERVE_MAX_ARG_LENGTH 4096
+#define SERVE_MAX_INLINE (UINT32_C(256) << 20)
+#define SERVE_TIMEOUT_SECONDS 10
+
+struct server {
+    int fd;
+    const struct args_state *args;
+    struct warm_cache warm;
+};
+
+static int read_all(int fd, void *data, size_t size) {
+    uint8_t *p = data;
+    while (size > 0) {
+        ssize_t rd = read(fd, p, size);
+        if ((rd < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (rd <= 0) {
+            return -1;
+        }
+        p += rd;
+        size -= rd;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const uint8_t *p = data;
+    while (size > 0) {
+        ssize_t wr = write(fd, p, size);
+        if ((wr < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (wr <= 0) {
+            return -1;
+        }
+        p += wr;
+        size -= wr;
+    }
+    return 0;
+}
+
+static int read_u32(int fd, uint32_t *v) {
+    uint8_t b[4];
+    if (read_all(fd, b, sizeof(b)) != 0) {
+        return -1;
+    }
+    *v = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return 0;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static void reply_job(int fd, int status, const struct job_report *report, double total_seconds, const char *message) {
+    size_t len = strlen(message);
+    uint8_t header[28];
+    uint8_t *p = header;
+    memcpy(p, SERVE_REPLY_MAGIC, 4);
+    p = put_u32(p + 4, (status == 0) ? 0 : 1);
+    p = put_u32(p, report->pictures);
+    p = put_u32(p, (uint32_t)(report->analysis_seconds * 1e6));
+    p = put_u32(p, (uint32_t)(report->render_seconds * 1e6));
+    p = put_u32(p, (uint32_t)(total_seconds * 1e6));
+    p = put_u32(p, len);
+    if ((write_all(fd, header, sizeof(header)) != 0) || (write_all(fd, message, len) != 0)) {
+        dprintf(2, "Cannot send the reply (%s)\n", strerror(errno));
+    }
+    return;
+}
+
+/* Reads the request into argv (argv[0] being a placeholder) and *image, returns the number of arguments or -1 */
+static int read_job(int fd, char **argv, uint8_t **image, uint32_t *image_size) {
+    char magic[4];
+    uint32_t argc;
+    if ((read_all(fd, magic, sizeof(magic)) != 0) || (memcmp(magic, SERVE_REQUEST_MAGIC, 4) != 0) || (read_u32(fd, &argc) != 0) || (argc > SERVE_MAX_ARGS)) {
+        return -1;
+    }
+    argv[0] = strdup("job");
+    if (argv[0] == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 1; i <= argc; ++i) {
+        uint32_t len;
+        if ((read_u32(fd, &len) != 0) || (len > SERVE_MAX_ARG_LENGTH) || ((argv[i] = malloc(len + 1)) == NULL)) {
+            return -1;
+        }
+        if (read_all(fd, argv[i], len) != 0) {
+            return -1;
+        }
+        argv[i][len] = '\0';
+    }
+    if ((read_u32(fd, image_size) != 0) || (*image_size > SERVE_MAX_INLINE)) {
+        return -1;
+    }
+    if (*image_size > 0) {
+        *image = malloc(*image_size);
+        if ((*image == NULL) || (read_all(fd, *image, *image_size) != 0)) {
+            return -1;
+        }
+    }
+    return argc + 1;
+}
+
+static void serve_job(struct server *sv, int fd) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char *argv[SERVE_MAX_ARGS + 2] = { NULL };
+    uint8_t *image = NULL;
+    uint32_t image_size = 0;
+    struct job_report report = { 0 };
+    struct args_state args = { 0 };
+    const char *message = NULL;
+    size_t last_mode;
+    int argc = read_job(fd, argv, &image, &image_size);
+    if (argc < 0) {
+        message = "malformed request";
+    } else if (parse_args(&args, argc, argv) != 0) {
+        message = "invalid options, see the server log";
+    } else if ((args.batch != NULL) || (args.serve != NULL) || (args.report != NULL) || args.perf_set || args.quiet_set || args.help_set) {
+        message = "--batch, --serve, --report, --perf, --quiet and --help are not available in jobs";
+    } else if ((image != NULL) && (args.source != NULL)) {
+        message = "a job has either a --source or an inline bitmap";
+    } else if ((image != NULL) && (args.dest_prefix == NULL) && (!args.output_set || (args.output == OUTPUT_BMP))) {
+        message = "inline bitmaps need a --destination_prefix";
+    }
+    if (message == NULL) {
+        if (image != NULL) {
+            args.source = "inline";
+        }
+        if (args.cache_dir == NULL) {
+            args.cache_dir = sv->args->cache_dir;
+        }
+        if ((set_deflts(&args) != 0) || (check_args(&args, &last_mode) != 0)) {
+            message = "invalid options, see the server log";
+        }
+    }
+    int r = -1;
+    if (message == NULL) {
+        struct raw_bitmap *bm0 = (image != NULL) ? load_bitmap(NULL, image, image_size) : load_source(&args);
+        free(image);
+        image = NULL;
+        r = (bm0 != NULL) ? run_image(&args, last_mode, bm0, &sv->warm, &report) : -1;
+        message = (r == 0) ? "done" : "failed, see the server log";
+    }
+    reply_job(fd, r, &report, elapsed_since(&start), message);
+    note("Job %s in %.3f s\n", message, elapsed_since(&start));
+    free(image);
+    for (size_t i = 0; i < SERVE_MAX_ARGS + 2; ++i) {
+        free(argv[i]);
+    }
+    return;
+}
+
+static void *serve_loop(void *arg) {
+    struct server *sv = arg;
+    while (1) {
+        int fd = accept(sv->fd, NULL, NULL);
+        if (fd == -1) {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) {
+                continue;
+            }
+            /* The listening socket was shut down */
+            break;
+        }
+        /* Reads and writes then fail with EAGAIN, which read_job takes for a malformed request */
+        struct timeval timeout = { .tv_sec = SERVE_TIMEOUT_SECONDS };
+        if ((setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) || (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0)) {
+            dprintf(2, "Cannot set the timeouts of a connection (%s)\n", strerror(errno));
+            close(fd);
+            continue;
+        }
+        serve_job(sv, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* Serves jobs until SIGINT or SIGTERM */
+static int serve(const struct args_state *args) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(args->serve) >= sizeof(addr.sun_path)) {
+        dprintf(2, "Socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, args->serve);
+    struct stat st;
+    if ((stat(args->serve, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        (void)unlink(args->serve);
+    }
+    struct server *sv = calloc(1, sizeof(*sv));
+    if (sv == NULL) {
+        return -1;
+    }
+    sv->args = args;
+    sv->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((sv->fd == -1) || (bind(sv->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(sv->fd, 16) != 0)) {
+        dprintf(2, "Cannot listen on %s (%s)\n", args->serve, strerror(errno));
+        if (sv->fd != -1) {
+            close(sv->fd);
+        }
+        free(sv);
+        return -1;
+    }
+    pthread_mutex_init(&sv->warm.lock, NULL);
+    /* Signals are only taken by sigwait, and a client leaving early makes writes fail instead of killing the server */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    pthread_t *workers = malloc(args->threads * sizeof(*workers));
+    size_t started = 0;
+    while ((workers != NULL) && (started < args->threads) && (pthread_create(&workers[started], NULL, serve_loop, sv) == 0)) {
+        ++started;
+    }
+    int ret = 0;
+    if (started == 0) {
+        dprintf(2, "Cannot start the server threads\n");
+        ret = -1;
+    } else {
+        note("Listening on %s\n", args->serve);
+        sigdelset(&signals, SIGPIPE);
+        int sig;
+        (void)sigwait(&signals, &sig);
+        note("Stopping\n");
+    }
+    (void)shutdown(sv->fd, SHUT_RDWR);
+    for (size_t j = 0; j < started; ++j) {
+        pthread_join(workers[j], NULL);
+    }
+    free(workers);
+    close(sv->fd);
+    (void)unlink(args->serve);
+    for (size_t i = 0; i < WARM_ENTRIES; ++i) {
+        destroy_doubles_list(sv->warm.entries[i].sx);
+        destroy_doubles_list(sv->warm.entries[i].sy);
+    }
+    pthread_mutex_destroy(&sv->warm.lock);
+    free(sv);
     return ret;
 }
+
+int main(int argc, char **argv) {
+    struct args_state args = { 0 };
+    int r;
+    r = parse_args(&args, argc, argv);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+    r = set_deflts(&args);
+    if (r != 0) {
+        args.help_set = 1;
+    }
+
+    if (args.help_set) {
+        show_help(argv[0]);
+        return -1;
+    }
+    size_t last_mode;
+    if (check_args(&args, &last_mode) != 0) {
+        return -1;
+    }
+    set_quiet(args.quiet_set);
+    if (args.report != NULL) {
+        enable_probes(args.perf_set);
+    }
+    if (args.serve != NULL) {
+        r = serve(&args);
+    } else if (args.batch != NULL) {
+        r = run_batch(&args, last_mode);
+    } else {
+        struct raw_bitmap *bm0 = load_source(&args);
+        struct job_report report;
+        r = (bm0 != NULL) ? run_image(&args, last_mode, bm0, NULL, &report) : -1;
+        if (r == 0) {
+            note("-- DONE --\n");
+        }
+    }
+    if ((args.report != NULL) && (write_probe_report(args.report) != 0)) {
+        r = -1;
+    }
+    return r;
+}
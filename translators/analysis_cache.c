@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "analysis_cache.h"
+
+#define CACHE_MAGIC "MFCACHE"
+#define CACHE_BYTE_ORDER UINT32_C(0x01020304)
+
+struct cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t key;
+    uint64_t modes;
+    uint64_t points;
+};
+
+/* Numbers the temporary files of the process, threads storing the same key each writing their own */
+static _Atomic unsigned long temp_files_ = 0;
+
+/* Mapping shared by the X and Y coefficients, unmapped with the last of them */
+struct cache_mapping {
+    void *addr;
+    size_t size;
+    unsigned int users;
+};
+
+static void release_mapping_(void *context) {
+    struct cache_mapping *m = context;
+    --m->users;
+    if (m->users == 0) {
+        (void)munmap(m->addr, m->size);
+        free(m);
+    }
+    return;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static size_t entry_size_(uint64_t modes, uint64_t points) {
+    return sizeof(struct cache_header) + 2 * modes * sizeof(double) + points * sizeof(struct point);
+}
+
+int load_analysis(const char *fname, uint64_t key, size_t modes, struct points_list **cycle, struct doubles_list **sx, struct doubles_list **sy) {
+    *cycle = NULL;
+    *sx = NULL;
+    *sy = NULL;
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(struct cache_header))) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    /* Private and writable, so that the coefficients can be handed over as regular lists */
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    const struct cache_header *h = addr;
+    if ((memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) != 0) || (h->version != ANALYSIS_CACHE_VERSION) || (h->byte_order != CACHE_BYTE_ORDER) || (h->key != key)
+            || (h->modes > size) || (h->points > size) || (entry_size_(h->modes, h->points) != size)) {
+        dprintf(2, "Ignoring stale cache file %s\n", fname);
+        (void)munmap(addr, size);
+        return -1;
+    }
+    double *coefs = (double *)(h + 1);
+    const struct point *pts = (const struct point *)(coefs + 2 * h->modes);
+    *cycle = create_points_list(h->points);
+    if (*cycle == NULL) {
+        (void)munmap(addr, size);
+        return -1;
+    }
+    for (size_t i = 0; i < h->points; ++i) {
+        (void)set_point_from_points_list(*cycle, i, &pts[i]);
+    }
+    struct cache_mapping *m = (h->modes >= modes) ? malloc(sizeof(*m)) : NULL;
+    if (m == NULL) {
+        (void)munmap(addr, size);
+        return 0;
+    }
+    m->addr = addr;
+    m->size = size;
+    *sx = wrap_doubles_list(h->modes, coefs, release_mapping_, m);
+    *sy = wrap_doubles_list(h->modes, coefs + h->modes, release_mapping_, m);
+    m->users = (*sx != NULL) + (*sy != NULL);
+    if ((*sx == NULL) || (*sy == NULL)) {
+        if (m->users == 0) {
+            (void)munmap(addr, size);
+            free(m);
+        }
+        destroy_doubles_list(*sx);
+        destroy_doubles_list(*sy);
+        *sx = NULL;
+        *sy = NULL;
+    }
+    return 0;
+}
+
+int store_analysis(const char *fname, uint64_t key, const struct points_list *cycle, const struct doubles_list *sx, const struct doubles_list *sy) {
+    size_t modes = get_doubles_num(sx);
+    size_t points = get_points_num(cycle);
+    if ((modes == 0) || (get_doubles_num(sy) != modes) || (points == 0)) {
+        return -1;
+    }
+    size_t size = entry_size_(modes, points);
+    uint8_t *data = malloc(size);
+    size_t name_size = strlen(fname) + 48;
+    char *tmp_name = malloc(name_size);
+    if ((data == NULL) || (tmp_name == NULL)) {
+        free(data);
+        free(tmp_name);
+        return -1;
+    }
+    struct cache_header *h = (struct cache_header *)data;
+    memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+    h->version = ANALYSIS_CACHE_VERSION;
+    h->byte_order = CACHE_BYTE_ORDER;
+    h->key = key;
+    h->modes = modes;
+    h->points = points;
+    double *coefs = (double *)(h + 1);
+    memcpy(coefs, get_doubles_array(sx), modes * sizeof(double));
+    memcpy(coefs + modes, get_doubles_array(sy), modes * sizeof(double));
+    struct point *pts = (struct point *)(coefs + 2 * modes);
+    for (size_t i = 0; i < points; ++i) {
+        (void)get_point_from_points_list(cycle, i, &pts[i]);
+    }
+
+    (void)snprintf(tmp_name, name_size, "%s.%ld.%lu", fname, (long)getpid(), atomic_fetch_add(&temp_files_, 1));
+    int fd = open(tmp_name, O_CREAT | O_EXCL | O_WRONLY, 0664);
+    if (fd == -1) {
+        dprintf(2, "Cannot open file %s (%s)\n", tmp_name, strerror(errno));
+        free(data);
+        free(tmp_name);
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t wr = write(fd, data + written, size - written);
+        if ((wr < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (wr <= 0) {
+            break;
+        }
+        written += wr;
+    }
+    if (close(fd) != 0) {
+        written = 0;
+    }
+    int r = 0;
+    if (written != size) {
+        dprintf(2, "Cannot write the file (%s)\n", strerror(errno));
+        r = -1;
+    } else if (rename(tmp_name, fname) != 0) {
+        dprintf(2, "Cannot rename %s to %s (%s)\n", tmp_name, fname, strerror(errno));
+        r = -1;
+    }
+    if (r != 0) {
+        (void)unlink(tmp_name);
+    }
+    free(data);
+    free(tmp_name);
+    return r;
+}
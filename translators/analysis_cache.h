@@ -0,0 +1,31 @@
+#ifndef ANALYSIS_CACHE_H
+#define ANALYSIS_CACHE_H
+
+#include <stdint.h>
+#include "../types/pointslist.h"
+#include "../types/doubleslist.h"
+
+/*
+ * Cache file holding the cycle of an image and its X and Y coefficients:
+ * "MFCACHE" header (version, byte order mark, key, number of modes, number
+ * of points), then the X and Y coefficients as doubles and the cycle as
+ * struct point, all in the byte order of the host which wrote it.
+ */
+#define ANALYSIS_CACHE_VERSION 1
+
+/* 64 bits FNV-1a, chained from ANALYSIS_HASH_SEED */
+#define ANALYSIS_HASH_SEED UINT64_C(0xcbf29ce484222325)
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size);
+
+/*
+ * Returns -1 unless fname holds an entry for key. Otherwise *cycle is a copy
+ * of the cycle, and *sx and *sy map the coefficients back from the file when
+ * it holds at least modes of them, being NULL if not.
+ */
+int load_analysis(const char *fname, uint64_t key, size_t modes, struct points_list **cycle, struct doubles_list **sx, struct doubles_list **sy);
+
+/* Writes the entry to a temporary file renamed to fname, so that readers never see it partially written */
+int store_analysis(const char *fname, uint64_t key, const struct points_list *cycle, const struct doubles_list *sx, const struct doubles_list *sy);
+
+#endif
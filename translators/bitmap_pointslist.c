@@ -1,8 +1,57 @@
 #include "bitmap_pointslist.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-static size_t get_points_(const struct raw_bitmap *bm, struct points_list *pts, uint32_t pixel) {
+/* Pixels in file order, the first one being the most significant bit */
+static uint32_t row_bits_(uint32_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(word);
+#else
+    return word;
+#endif
+}
+
+/* Scans whole words of 1 bit per pixel rows, so that the work follows the ink rather than the area */
+static size_t get_points_1bpp_(const struct raw_bitmap *bm, struct points_list *pts, uint32_t pixel) {
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    if ((pixel > 1) || (rbi.width == 0)) {
+        return 0;
+    }
+    size_t words = (rbi.width + 31) >> 5;
+    uint32_t invert = (pixel == 0) ? UINT32_MAX : 0;
+    uint32_t tail = ((rbi.width % 32) == 0) ? UINT32_MAX : ~(UINT32_MAX >> (rbi.width % 32));
+    size_t points = 0;
+    for (uint32_t j = 0; j < rbi.height; ++j) {
+        const uint8_t *row = get_row_bytes(bm, j);
+        for (size_t w = 0; w < words; ++w) {
+            uint32_t word;
+            memcpy(&word, row + w * sizeof(word), sizeof(word));
+            uint32_t bits = row_bits_(word) ^ invert;
+            if (w == words - 1) {
+                bits &= tail;
+            }
+            if (pts == NULL) {
+                points += __builtin_popcount(bits);
+                continue;
+            }
+            while (bits != 0) {
+                unsigned int b = __builtin_clz(bits);
+                struct point pt = {
+                    .x = w * 32 + b,
+                    .y = j,
+                };
+                set_point_from_points_list(pts, points, &pt);
+                ++points;
+                bits &= ~(UINT32_C(0x80000000) >> b);
+            }
+        }
+    }
+    return points;
+}
+
+/* line holds a row of color indexes, unused at 1 bit per pixel */
+static size_t get_points_(const struct raw_bitmap *bm, struct points_list *pts, uint32_t pixel, uint32_t *line) {
     size_t points = 0;
     struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
     if (rbi.width > UINT16_MAX) {
@@ -11,11 +60,13 @@ static size_t get_points_(const struct raw_bitmap *bm, struct points_list *pts,
     if (rbi.height > UINT16_MAX) {
         return 0;
     }
+    if (rbi.bits_per_pixel == 1) {
+        return get_points_1bpp_(bm, pts, pixel);
+    }
     for (uint16_t j = 0; j < rbi.height; ++j) {
+        (void)get_row(bm, j, 0, rbi.width, line);
         for (uint16_t i = 0; i < rbi.width; ++i) {
-            uint32_t col;
-            (void)get_pixel(bm, i, j, &col);
-            if (col == pixel) {
+            if (line[i] == pixel) {
                 if (pts != NULL) {
                     struct point pt = {
                         .x = i,
@@ -30,13 +81,22 @@ static size_t get_points_(const struct raw_bitmap *bm, struct points_list *pts,
     return points;
 }
 
+/* Both passes share the row buffer, so that the second one cannot leave points unset */
 struct points_list *get_points_list(const struct raw_bitmap *bm, uint32_t pixel) {
-    size_t points = get_points_(bm, NULL, pixel);
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    uint32_t *line = NULL;
+    if (rbi.bits_per_pixel != 1) {
+        line = malloc(rbi.width * sizeof(uint32_t) + 1);
+        if (line == NULL) {
+            return NULL;
+        }
+    }
+    size_t points = get_points_(bm, NULL, pixel, line);
     struct points_list *pl = create_points_list(points);
-    if (pl == NULL) {
-        return NULL;
+    if (pl != NULL) {
+        (void)get_points_(bm, pl, pixel, line);
     }
-    (void)get_points_(bm, pl, pixel);
+    free(line);
     return pl;
 }
 
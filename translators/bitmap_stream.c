@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include "bitmap_stream.h"
+
+#define DELTA_MAGIC "BMPDELTA"
+/* Flag of the header: each frame starts with its label */
+#define DELTA_LABELLED 1
+/* Unchanged words bridged inside a patch rather than starting a new one, a patch costing 2 words */
+#define DELTA_GAP 2
+
+struct bitmap_stream {
+    int fd;
+    int format;
+    uint32_t width;
+    uint32_t height;
+    size_t frame_size;
+    uint32_t *line;
+    uint32_t *previous;
+    uint32_t *patches;
+    size_t words;
+    uint8_t frame[];
+};
+
+struct delta_reader {
+    int fd;
+    int failed;
+    struct raw_bitmap *bm;
+    uint8_t *canvas;
+    uint32_t *patch;
+    size_t words;
+    uint32_t flags;
+    uint32_t frames;
+};
+
+/* Number of bytes read, short of size only at the end of the file, -1 on error */
+static ssize_t read_upto_(int fd, uint8_t *data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t rd = read(fd, data + done, size - done);
+        if ((rd < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (rd < 0) {
+            dprintf(2, "Cannot read the stream (%s)\n", strerror(errno));
+            return -1;
+        }
+        if (rd == 0) {
+            break;
+        }
+        done += rd;
+    }
+    return done;
+}
+
+static int read_all_(int fd, uint8_t *data, size_t size) {
+    return (read_upto_(fd, data, size) == (ssize_t)size) ? 0 : -1;
+}
+
+static void put_32le_(uint32_t *word, uint32_t val) {
+    uint8_t *data = (uint8_t *)word;
+    data[0] = val;
+    data[1] = val >> 8;
+    data[2] = val >> 16;
+    data[3] = val >> 24;
+    return;
+}
+
+static uint32_t get_32le_(const uint32_t *word) {
+    const uint8_t *data = (const uint8_t *)word;
+    return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static int write_all_(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t wr = write(fd, data, size);
+        if (wr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            dprintf(2, "Cannot write the stream (%s)\n", strerror(errno));
+            return -1;
+        }
+        data += wr;
+        size -= wr;
+    }
+    return 0;
+}
+
+/* 5 bits per channel at 16 bits per pixel, 8 bits otherwise */
+static uint8_t direct_gray_(uint32_t v, uint16_t bits_per_pixel) {
+    uint32_t r, g, b;
+    if (bits_per_pixel == 16) {
+        r = ((v >> 10) & 0x1f) << 3;
+        g = ((v >> 5) & 0x1f) << 3;
+        b = (v & 0x1f) << 3;
+    } else {
+        r = (v >> 16) & 0xff;
+        g = (v >> 8) & 0xff;
+        b = v & 0xff;
+    }
+    return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+struct bitmap_stream *open_bitmap_stream(const char *fname, int format, uint32_t width, uint32_t height) {
+    if ((fname == NULL) || (width == 0) || (height == 0)) {
+        return NULL;
+    }
+    if ((format != BITMAP_STREAM_Y4M) && (format != BITMAP_STREAM_GRAY) && (format != BITMAP_STREAM_DELTA)) {
+        return NULL;
+    }
+    size_t luma = (format != BITMAP_STREAM_DELTA) ? (size_t)width * height : 0;
+    size_t chroma = (format == BITMAP_STREAM_Y4M) ? 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2) : 0;
+    struct bitmap_stream *bs = malloc(sizeof(*bs) + luma + chroma);
+    if (bs == NULL) {
+        return NULL;
+    }
+    bs->line = malloc(width * sizeof(uint32_t));
+    bs->previous = NULL;
+    bs->patches = NULL;
+    bs->words = 0;
+    if (bs->line == NULL) {
+        free(bs);
+        return NULL;
+    }
+    bs->format = format;
+    bs->width = width;
+    bs->height = height;
+    bs->frame_size = luma + chroma;
+    /* Chroma planes stay neutral */
+    memset(bs->frame + luma, 128, chroma);
+    if (strcmp(fname, "-") == 0) {
+        bs->fd = 1;
+    } else {
+        bs->fd = open(fname, O_CREAT | O_WRONLY | O_TRUNC, 0664);
+    }
+    if (bs->fd == -1) {
+        dprintf(2, "Cannot open file %s (%s)\n", fname, strerror(errno));
+        free(bs->line);
+        free(bs);
+        return NULL;
+    }
+    if (format == BITMAP_STREAM_Y4M) {
+        char header[128];
+        int len = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F25:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height);
+        if (write_all_(bs->fd, (const uint8_t *)header, len) != 0) {
+            (void)close_bitmap_stream(bs);
+            return NULL;
+        }
+    }
+    return bs;
+}
+
+/* The header waits for the first frame, which brings the depth and the color map */
+static int start_delta_(struct bitmap_stream *bs, const struct raw_bitmap *bm) {
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    bs->words = get_row_bytes_num(bm) / sizeof(uint32_t) * rbi.height;
+    bs->previous = calloc(bs->words + 1, sizeof(uint32_t));
+    /* Worst case: one patch per word, alternately changed and unchanged */
+    bs->patches = malloc((2 * bs->words + 4) * sizeof(uint32_t));
+    uint32_t *header = malloc(8 + 7 * sizeof(uint32_t) + rbi.colors_in_color_map * sizeof(struct rgba));
+    if ((bs->previous == NULL) || (bs->patches == NULL) || (header == NULL)) {
+        free(header);
+        return -1;
+    }
+    memcpy(header, DELTA_MAGIC, 8);
+    put_32le_(header + 2, rbi.width);
+    put_32le_(header + 3, rbi.height);
+    put_32le_(header + 4, rbi.bits_per_pixel);
+    put_32le_(header + 5, rbi.w_ppm);
+    put_32le_(header + 6, rbi.h_ppm);
+    put_32le_(header + 7, rbi.colors_in_color_map);
+    put_32le_(header + 8, DELTA_LABELLED);
+    (void)get_color_map(bm, (struct rgba *)(header + 9), rbi.colors_in_color_map);
+    int r = write_all_(bs->fd, (const uint8_t *)header, 9 * sizeof(uint32_t) + rbi.colors_in_color_map * sizeof(struct rgba));
+    free(header);
+    return r;
+}
+
+/* XORs the canvas with the previous one word by word, runs of changed words becoming patches */
+static int stream_delta_(struct bitmap_stream *bs, const struct raw_bitmap *bm, uint32_t label) {
+    if ((bs->previous == NULL) && (start_delta_(bs, bm) != 0)) {
+        return -1;
+    }
+    if (get_row_bytes_num(bm) / sizeof(uint32_t) * bs->height != bs->words) {
+        dprintf(2, "Picture depth does not match the stream\n");
+        return -1;
+    }
+    size_t line_words = get_row_bytes_num(bm) / sizeof(uint32_t);
+    uint32_t *out = bs->patches + 2;
+    uint32_t *patch = NULL;
+    size_t patches = 0;
+    size_t gap = 0;
+    for (uint32_t y = 0; y < bs->height; ++y) {
+        const uint8_t *row = get_row_bytes(bm, y);
+        uint32_t *previous = bs->previous + (size_t)y * line_words;
+        for (size_t w = 0; w < line_words; ++w) {
+            uint32_t word;
+            memcpy(&word, row + w * sizeof(word), sizeof(word));
+            uint32_t diff = word ^ previous[w];
+            if (diff == 0) {
+                ++gap;
+                continue;
+            }
+            previous[w] = word;
+            size_t index = (size_t)y * line_words + w;
+            if ((patch != NULL) && (gap <= DELTA_GAP)) {
+                while (gap > 0) {
+                    *out++ = 0;
+                    --gap;
+                }
+            } else {
+                if (patch != NULL) {
+                    put_32le_(patch + 1, out - patch - 2);
+                }
+                patch = out;
+                put_32le_(out, index);
+                out += 2;
+                ++patches;
+            }
+            gap = 0;
+            /* Stored as is, the XOR of two words is byte order agnostic */
+            *out++ = diff;
+        }
+    }
+    if (patch != NULL) {
+        put_32le_(patch + 1, out - patch - 2);
+    }
+    put_32le_(bs->patches, label);
+    put_32le_(bs->patches + 1, patches);
+    return write_all_(bs->fd, (const uint8_t *)bs->patches, (out - bs->patches) * sizeof(uint32_t));
+}
+
+int stream_bitmap(struct bitmap_stream *bs, const struct raw_bitmap *bm, uint32_t label) {
+    if ((bs == NULL) || (bm == NULL)) {
+        return -1;
+    }
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    if ((rbi.width != bs->width) || (rbi.height != bs->height)) {
+        dprintf(2, "Picture size does not match the stream\n");
+        return -1;
+    }
+    if (bs->format == BITMAP_STREAM_DELTA) {
+        return stream_delta_(bs, bm, label);
+    }
+    /* Gray level of each color index, paletted depths only */
+    uint8_t gray[256];
+    for (uint32_t c = 0; c < rbi.colors_in_color_map; ++c) {
+        struct rgba col;
+        (void)get_color(bm, c, &col);
+        gray[c] = (77 * col.r + 150 * col.g + 29 * col.b) >> 8;
+    }
+    /* Bitmap rows go upwards, stream rows downwards */
+    for (uint32_t y = 0; y < rbi.height; ++y) {
+        uint8_t *out = bs->frame + (size_t)(rbi.height - 1 - y) * rbi.width;
+        (void)get_row(bm, y, 0, rbi.width, bs->line);
+        if (rbi.colors_in_color_map > 0) {
+            for (uint32_t x = 0; x < rbi.width; ++x) {
+                out[x] = gray[bs->line[x]];
+            }
+        } else {
+            for (uint32_t x = 0; x < rbi.width; ++x) {
+                out[x] = direct_gray_(bs->line[x], rbi.bits_per_pixel);
+            }
+        }
+    }
+    if (bs->format == BITMAP_STREAM_Y4M) {
+        if (write_all_(bs->fd, (const uint8_t *)"FRAME\n", 6) != 0) {
+            return -1;
+        }
+    }
+    return write_all_(bs->fd, bs->frame, bs->frame_size);
+}
+
+int close_bitmap_stream(struct bitmap_stream *bs) {
+    if (bs == NULL) {
+        return -1;
+    }
+    int r = 0;
+    if ((bs->fd != 1) && (close(bs->fd) != 0)) {
+        dprintf(2, "Cannot close the stream (%s)\n", strerror(errno));
+        r = -1;
+    }
+    free(bs->line);
+    free(bs->previous);
+    free(bs->patches);
+    free(bs);
+    return r;
+}
+
+struct delta_reader *open_delta_reader(const char *fname) {
+    struct delta_reader *dr = malloc(sizeof(*dr));
+    if (dr == NULL) {
+        return NULL;
+    }
+    dr->fd = (strcmp(fname, "-") == 0) ? 0 : open(fname, O_RDONLY);
+    if (dr->fd == -1) {
+        dprintf(2, "Cannot open file %s (%s)\n", fname, strerror(errno));
+        free(dr);
+        return NULL;
+    }
+    dr->failed = 0;
+    dr->bm = NULL;
+    dr->patch = NULL;
+    dr->frames = 0;
+    uint32_t header[9];
+    if ((read_all_(dr->fd, (uint8_t *)header, sizeof(header)) != 0) || (memcmp(header, DELTA_MAGIC, 8) != 0)) {
+        dprintf(2, "Not a delta stream\n");
+        (void)close_delta_reader(dr);
+        return NULL;
+    }
+    struct raw_bitmap_info rbi = {
+        .width = get_32le_(header + 2),
+        .height = get_32le_(header + 3),
+        .bits_per_pixel = get_32le_(header + 4),
+        .w_ppm = get_32le_(header + 5),
+        .h_ppm = get_32le_(header + 6),
+        .colors_in_color_map = get_32le_(header + 7),
+    };
+    dr->flags = get_32le_(header + 8);
+    struct rgba color_map[256];
+    if ((rbi.colors_in_color_map > 256) || (read_all_(dr->fd, (uint8_t *)color_map, rbi.colors_in_color_map * sizeof(struct rgba)) != 0)) {
+        dprintf(2, "Truncated delta stream\n");
+        (void)close_delta_reader(dr);
+        return NULL;
+    }
+    dr->bm = create_raw_bitmap(rbi);
+    if (dr->bm == NULL) {
+        dprintf(2, "Unsupported delta stream\n");
+        (void)close_delta_reader(dr);
+        return NULL;
+    }
+    (void)set_color_map(dr->bm, color_map, rbi.colors_in_color_map);
+    dr->canvas = get_mutable_row_bytes(dr->bm, 0);
+    dr->words = get_row_bytes_num(dr->bm) / sizeof(uint32_t) * rbi.height;
+    dr->patch = malloc(dr->words * sizeof(uint32_t) + 1);
+    if (dr->patch == NULL) {
+        (void)close_delta_reader(dr);
+        return NULL;
+    }
+    return dr;
+}
+
+const struct raw_bitmap *next_delta_frame(struct delta_reader *dr, uint32_t *label) {
+    if ((dr == NULL) || dr->failed) {
+        return NULL;
+    }
+    /* Label, if any, then number of patches */
+    uint32_t start[2];
+    _Bool labelled = (dr->flags & DELTA_LABELLED) != 0;
+    size_t start_size = labelled ? sizeof(start) : sizeof(uint32_t);
+    ssize_t rd = read_upto_(dr->fd, (uint8_t *)start, start_size);
+    if (rd == 0) {
+        return NULL;
+    }
+    if (rd != (ssize_t)start_size) {
+        dr->failed = 1;
+        return NULL;
+    }
+    if (label != NULL) {
+        *label = labelled ? get_32le_(start) : dr->frames;
+    }
+    uint32_t patches = get_32le_(labelled ? start + 1 : start);
+    for (uint32_t p = 0; p < patches; ++p) {
+        uint32_t range[2];
+        if (read_all_(dr->fd, (uint8_t *)range, sizeof(range)) != 0) {
+            dr->failed = 1;
+            return NULL;
+        }
+        size_t index = get_32le_(range);
+        size_t count = get_32le_(range + 1);
+        if ((index > dr->words) || (count > dr->words - index)) {
+            dr->failed = 1;
+            return NULL;
+        }
+        if (read_all_(dr->fd, (uint8_t *)dr->patch, count * sizeof(uint32_t)) != 0) {
+            dr->failed = 1;
+            return NULL;
+        }
+        uint8_t *words = dr->canvas + index * sizeof(uint32_t);
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t word;
+            memcpy(&word, words + k * sizeof(word), sizeof(word));
+            word ^= dr->patch[k];
+            memcpy(words + k * sizeof(word), &word, sizeof(word));
+        }
+    }
+    ++dr->frames;
+    return dr->bm;
+}
+
+int close_delta_reader(struct delta_reader *dr) {
+    if (dr == NULL) {
+        return -1;
+    }
+    int r = dr->failed ? -1 : 0;
+    if (dr->fd > 0) {
+        close(dr->fd);
+    }
+    destroy_raw_bitmap(dr->bm);
+    free(dr->patch);
+    free(dr);
+    return r;
+}
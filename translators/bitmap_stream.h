@@ -0,0 +1,41 @@
+#ifndef BITMAP_STREAM_H
+#define BITMAP_STREAM_H
+
+#include <stdint.h>
+#include "../types/bitmap.h"
+
+/* Sequence of pictures of one size written to a single file, pipe or FIFO ("-" stands for the standard output) */
+struct bitmap_stream;
+
+/* YUV4MPEG2 (4:2:0, full range), raw 8 bits grayscale frames, pixel array patches against the previous frame */
+#define BITMAP_STREAM_Y4M 0
+#define BITMAP_STREAM_GRAY 1
+#define BITMAP_STREAM_DELTA 2
+
+struct bitmap_stream *open_bitmap_stream(const char *fname, int format, uint32_t width, uint32_t height);
+
+/* Appends one frame, converted from the color map of bm to gray levels; label is only kept by delta streams */
+int stream_bitmap(struct bitmap_stream *bs, const struct raw_bitmap *bm, uint32_t label);
+
+int close_bitmap_stream(struct bitmap_stream *bs);
+
+/*
+ * Delta streams: "BMPDELTA" header (info, flags, color map), then per frame a
+ * label (when the flags have bit 0 set, mini_fourier storing the last mode of
+ * the picture) and a number of patches, each patch being a word offset, a
+ * number of words and those words XOR-ed with the previous frame (the first
+ * one against a blank canvas). The header, labels, offsets and counts are 32
+ * bits little endian words; the patch words are the XOR of the pixel bytes
+ * taken as host order words, so they are the raw bytes whatever the byte order.
+ */
+struct delta_reader;
+
+struct delta_reader *open_delta_reader(const char *fname);
+
+/* Next frame, owned by the reader and valid until the next call, NULL at the end of the stream or on error; label is its index in streams without labels */
+const struct raw_bitmap *next_delta_frame(struct delta_reader *dr, uint32_t *label);
+
+/* 0 once the whole stream has been read, -1 if it ended on an error */
+int close_delta_reader(struct delta_reader *dr);
+
+#endif
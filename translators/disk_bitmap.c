@@ -5,89 +5,318 @@
 #include <errno.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include "disk_bitmap.h"
+#include "../types/probe.h"
 
 static uint16_t read_16le(uint8_t *data, size_t *offset);
 static uint32_t read_32le(uint8_t *data, size_t *offset);
 static void write_16le(uint8_t *data, size_t *offset, uint16_t val);
 static void write_32le(uint8_t *data, size_t *offset, uint32_t val);
-static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap);
-static void dump_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap);
+static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap, uint32_t *compression, size_t *bitmap_size);
+static void dump_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap, uint32_t compression, uint32_t bitmap_size);
 
-struct raw_bitmap *disk_to_bitmap(const char *fname) {
-    int fd = open(fname, O_RDONLY);
-    if (fd == -1) {
-        dprintf(2, "Cannot open file %s (%s)\n", fname, strerror(errno));
-        return NULL;
+#define BI_RGB 0
+#define BI_RLE8 1
+#define BI_RLE4 2
+
+struct mapping {
+    void *addr;
+    size_t size;
+};
+
+static void unmap_(void *context) {
+    struct mapping *m = context;
+    (void)munmap(m->addr, m->size);
+    free(m);
+    return;
+}
+
+/* Flushes the decoded row y, pixels the run length encoding skipped keeping index 0 */
+static void flush_rle_row_(struct raw_bitmap *bm, uint32_t *line, uint32_t width, uint32_t y) {
+    (void)set_row(bm, y, 0, width, line);
+    memset(line, 0, width * sizeof(*line));
+    return;
+}
+
+/* Decodes a BI_RLE8 or BI_RLE4 pixel array into bm, whose pixels all start at index 0 */
+static int decode_rle_(struct raw_bitmap *bm, const uint8_t *data, size_t size, _Bool nibbles) {
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    uint32_t *line = calloc(rbi.width + 1, sizeof(*line));
+    if (line == NULL) {
+        return -1;
     }
-    off_t fsize = lseek(fd, 0, SEEK_END);
-    if (fsize < 0) {
-        dprintf(2, "Cannot determine file size (%s)\n", strerror(errno));
+    uint32_t x = 0;
+    uint32_t y = 0;
+    size_t i = 0;
+    int r = 0;
+    while ((y < rbi.height) && (i + 1 < size)) {
+        uint32_t count = data[i];
+        uint32_t value = data[i + 1];
+        i += 2;
+        if (count > 0) {
+            /* Encoded run, nibbles alternating from the high one */
+            for (uint32_t k = 0; (k < count) && (x < rbi.width); ++k, ++x) {
+                line[x] = !nibbles ? value : ((k & 1) ? (value & 0xf) : (value >> 4));
+            }
+            continue;
+        }
+        if (value == 0) {
+            flush_rle_row_(bm, line, rbi.width, y);
+            x = 0;
+            ++y;
+        } else if (value == 1) {
+            break;
+        } else if (value == 2) {
+            if (i + 1 >= size) {
+                r = -1;
+                break;
+            }
+            uint32_t dx = data[i];
+            uint32_t dy = data[i + 1];
+            i += 2;
+            for (; (dy > 0) && (y < rbi.height); --dy) {
+                flush_rle_row_(bm, line, rbi.width, y);
+                ++y;
+            }
+            x += dx;
+        } else {
+            /* Absolute run of value pixels, padded to 16 bits */
+            size_t bytes = nibbles ? (value + 1) / 2 : value;
+            if (i + bytes > size) {
+                r = -1;
+                break;
+            }
+            for (uint32_t k = 0; (k < value) && (x < rbi.width); ++k, ++x) {
+                line[x] = !nibbles ? data[i + k] : ((k & 1) ? (data[i + k / 2] & 0xf) : (data[i + k / 2] >> 4));
+            }
+            i += (bytes + 1) & ~(size_t)1;
+        }
+    }
+    if (y < rbi.height) {
+        flush_rle_row_(bm, line, rbi.width, y);
+    }
+    free(line);
+    return r;
+}
+
+/* Builds the bitmap from a whole file image, sharing its pixel array when held by a mapping, the mapping being released otherwise */
+static struct raw_bitmap *data_to_bitmap_(uint8_t *data, size_t data_size, struct mapping *m) {
+    struct raw_bitmap_info rbi;
+    struct rgba *color_map;
+    uint8_t *bitmap;
+    uint32_t compression;
+    size_t bitmap_size;
+    int r = parse_bitmap_info_(data, data_size, &rbi, &color_map, &bitmap, &compression, &bitmap_size);
+    if (r != 0) {
+        dprintf(2, "Unsupported file format\n");
+        if (m != NULL) {
+            unmap_(m);
+        }
         return NULL;
     }
-    size_t data_size = (size_t)fsize;
+    _Bool shared = (m != NULL) && (compression == BI_RGB);
+    struct raw_bitmap *bm = shared ? wrap_raw_bitmap(rbi, bitmap, unmap_, m) : create_raw_bitmap(rbi);
+    if (bm != NULL) {
+        (void)set_color_map(bm, color_map, rbi.colors_in_color_map);
+        if (compression != BI_RGB) {
+            if (decode_rle_(bm, bitmap, bitmap_size, compression == BI_RLE4) != 0) {
+                dprintf(2, "Corrupted run length encoded bitmap\n");
+                destroy_raw_bitmap(bm);
+                bm = NULL;
+            }
+        } else if (!shared) {
+            (void)set_bitmap(bm, bitmap, bitmap_size);
+        }
+    }
+    if ((m != NULL) && ((bm == NULL) || !shared)) {
+        unmap_(m);
+    }
+    return bm;
+}
+
+static struct raw_bitmap *read_to_bitmap_(int fd, size_t data_size) {
     uint8_t *data = malloc(data_size);
     if (data == NULL) {
         dprintf(2, "Cannot allocate the image in memory\n");
         return NULL;
     }
-    lseek(fd, 0, SEEK_SET);
-    ssize_t rd = read(fd, data, (size_t)fsize);
-    if (rd != (ssize_t)fsize) {
+    ssize_t rd = pread(fd, data, data_size, 0);
+    if (rd != (ssize_t)data_size) {
         dprintf(2, "Cannot read the file (%s)\n", strerror(errno));
         free(data);
         return NULL;
     }
-    struct raw_bitmap_info rbi;
-    struct rgba *color_map;
-    uint8_t *bitmap;
-    int r = parse_bitmap_info_(data, data_size, &rbi, &color_map, &bitmap);
-    if (r != 0) {
-        dprintf(2, "Unsupported file format\n");
-        free(data);
+    struct raw_bitmap *bm = data_to_bitmap_(data, data_size, NULL);
+    free(data);
+    return bm;
+}
+
+struct raw_bitmap *memory_to_bitmap(const uint8_t *data, size_t data_size) {
+    if (data == NULL) {
         return NULL;
     }
-    struct raw_bitmap *bm = create_raw_bitmap(rbi);
-    if (bm == NULL) {
-        free(data);
+    return data_to_bitmap_((uint8_t *)data, data_size, NULL);
+}
+
+/*
+ * The file is mapped privately: pixels are read in place, and pages written
+ * to are copied by the kernel, leaving the file untouched. Run length encoded
+ * pixel arrays are decoded once into the bitmap.
+ */
+struct raw_bitmap *disk_to_bitmap(const char *fname) {
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        dprintf(2, "Cannot open file %s (%s)\n", fname, strerror(errno));
         return NULL;
     }
-    size_t line_width = ((rbi.width * rbi.bits_per_pixel + 31) >> 5) << 2;
-    size_t bitmap_size = line_width * rbi.height;
-    (void)set_color_map(bm, color_map, rbi.colors_in_color_map);
-    (void)set_bitmap(bm, bitmap, bitmap_size);
-    free(data);
-    return bm;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        dprintf(2, "Cannot determine file size (%s)\n", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    size_t data_size = (size_t)st.st_size;
+    struct mapping *m = malloc(sizeof(*m));
+    void *addr = (data_size > 0) ? mmap(NULL, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if ((m == NULL) || (addr == MAP_FAILED)) {
+        free(m);
+        if (addr != MAP_FAILED) {
+            (void)munmap(addr, data_size);
+        }
+        struct raw_bitmap *bm = read_to_bitmap_(fd, data_size);
+        close(fd);
+        return bm;
+    }
+    close(fd);
+    m->addr = addr;
+    m->size = data_size;
+    return data_to_bitmap_(addr, data_size, m);
 }
 
-int bitmap_to_disk(const struct raw_bitmap *bm, const char *fname) {
+/* Appends the run length encoding of one row of color indexes, trailing index 0 pixels being left to the end of line */
+static uint8_t *encode_rle_row_(uint8_t *out, const uint32_t *line, uint32_t width, _Bool nibbles) {
+    while ((width > 0) && (line[width - 1] == 0)) {
+        --width;
+    }
+    uint32_t x = 0;
+    while (x < width) {
+        uint32_t run = 1;
+        while ((x + run < width) && (run < 255) && (line[x + run] == line[x])) {
+            ++run;
+        }
+        if (run > 1) {
+            *out++ = run;
+            *out++ = nibbles ? (line[x] << 4) | line[x] : line[x];
+            x += run;
+            continue;
+        }
+        /* Literal pixels, up to the next run of two */
+        uint32_t end = x + 1;
+        while ((end < width) && (end - x < 255) && ((end + 1 == width) || (line[end + 1] != line[end]))) {
+            ++end;
+        }
+        uint32_t count = end - x;
+        if (count < 3) {
+            /* Absolute mode needs at least 3 pixels */
+            for (; x < end; ++x) {
+                *out++ = 1;
+                *out++ = nibbles ? line[x] << 4 : line[x];
+            }
+            continue;
+        }
+        *out++ = 0;
+        *out++ = count;
+        size_t bytes = nibbles ? (count + 1) / 2 : count;
+        if (nibbles) {
+            for (uint32_t k = 0; k < count; k += 2) {
+                uint32_t low = (k + 1 < count) ? line[x + k + 1] : 0;
+                *out++ = (line[x + k] << 4) | low;
+            }
+        } else {
+            for (uint32_t k = 0; k < count; ++k) {
+                *out++ = line[x + k];
+            }
+        }
+        if ((bytes & 1) != 0) {
+            *out++ = 0;
+        }
+        x = end;
+    }
+    return out;
+}
+
+/*
+ * Serialises bm into *buffer, grown when needed so that it can be reused from
+ * one picture to the next. With rle, palette bitmaps are run length encoded
+ * in a single pass over their rows: as RLE4 up to 16 colors (1 bit canvases
+ * are widened to 4 bits, BMP having no 1 bit encoding), as RLE8 above.
+ */
+static int write_bitmap_(const struct raw_bitmap *bm, const char *fname, _Bool rle, uint8_t **buffer, size_t *capacity) {
     if (bm == NULL) {
         dprintf(2, "No bitmap provided\n");
         return -1;
     }
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    rle = rle && (rbi.bits_per_pixel <= 8);
+    uint32_t compression = BI_RGB;
+    size_t bitmap_size;
+    size_t scratch_size = 0;
+    if (rle) {
+        compression = (rbi.colors_in_color_map <= 16) ? BI_RLE4 : BI_RLE8;
+        /* At worst 2 bytes per pixel, plus the end of line */
+        bitmap_size = ((size_t)rbi.width * 2 + 2) * rbi.height + 2;
+        scratch_size = rbi.width * sizeof(uint32_t);
+    } else {
+        size_t line_width = ((rbi.width * rbi.bits_per_pixel + 31) >> 5) << 2;
+        bitmap_size = line_width * rbi.height;
+    }
+    size_t color_map_size = sizeof(struct rgba) * rbi.colors_in_color_map;
+    size_t file_size = 54 + color_map_size + bitmap_size;
+    size_t scratch_offset = (file_size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+    size_t needed = scratch_offset + scratch_size;
+    if (needed > *capacity) {
+        uint8_t *data = realloc(*buffer, needed);
+        if (data == NULL) {
+            dprintf(2, "Cannot allocate %zu bytes\n", needed);
+            return -1;
+        }
+        *buffer = data;
+        *capacity = needed;
+    }
     int fd = open(fname, O_CREAT | O_WRONLY | O_EXCL, 0664);
     if (fd == -1) {
         dprintf(2, "Cannot open file %s (%s)\n", fname, strerror(errno));
         return -1;
     }
-    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
-    size_t line_width = ((rbi.width * rbi.bits_per_pixel + 31) >> 5) << 2;
-    size_t bitmap_size = line_width * rbi.height;
-    size_t file_size = 54 + sizeof(struct rgba) * rbi.colors_in_color_map + bitmap_size;
-    uint8_t *data = malloc(file_size);
-    if (data == NULL) {
-        dprintf(2, "Cannot allocate %zu bytes\n", file_size);
-        return -1;
-    }
     struct rgba *color_map;
-    uint8_t *bitmap;
-    dump_bitmap_info_(data, file_size, &rbi, &color_map, &bitmap);
+    uint8_t *bitmap = *buffer + 54 + color_map_size;
+    if (rle) {
+        uint32_t *line = (uint32_t *)(*buffer + scratch_offset);
+        uint8_t *out = bitmap;
+        for (uint32_t y = 0; y < rbi.height; ++y) {
+            (void)get_row(bm, y, 0, rbi.width, line);
+            out = encode_rle_row_(out, line, rbi.width, compression == BI_RLE4);
+            *out++ = 0;
+            *out++ = (y + 1 < rbi.height) ? 0 : 1;
+        }
+        bitmap_size = out - bitmap;
+        file_size = 54 + color_map_size + bitmap_size;
+        rbi.bits_per_pixel = (compression == BI_RLE4) ? 4 : 8;
+    }
+    dump_bitmap_info_(*buffer, file_size, &rbi, &color_map, &bitmap, compression, rle ? bitmap_size : 0);
     (void)get_color_map(bm, color_map, rbi.colors_in_color_map);
-    (void)get_bitmap(bm, bitmap, bitmap_size);
+    if (!rle) {
+        (void)get_bitmap(bm, bitmap, bitmap_size);
+    }
 
-    ssize_t rd = write(fd, data, file_size);
-    free(data);
+    ssize_t rd = write(fd, *buffer, file_size);
+    if (close(fd) != 0) {
+        rd = -1;
+    }
     if (rd != (ssize_t)file_size) {
         dprintf(2, "Cannot write the file (%s)\n", strerror(errno));
         return -1;
@@ -95,6 +324,148 @@ int bitmap_to_disk(const struct raw_bitmap *bm, const char *fname) {
     return 0;
 }
 
+int bitmap_to_disk(const struct raw_bitmap *bm, const char *fname) {
+    uint8_t *buffer = NULL;
+    size_t capacity = 0;
+    int r = write_bitmap_(bm, fname, 0, &buffer, &capacity);
+    free(buffer);
+    return r;
+}
+
+int bitmap_to_disk_rle(const struct raw_bitmap *bm, const char *fname) {
+    uint8_t *buffer = NULL;
+    size_t capacity = 0;
+    int r = write_bitmap_(bm, fname, 1, &buffer, &capacity);
+    free(buffer);
+    return r;
+}
+
+struct pending {
+    struct raw_bitmap *bm;
+    char *fname;
+};
+
+struct bitmap_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t depth;
+    size_t head;
+    size_t queued;
+    size_t written;
+    _Bool rle;
+    _Bool closing;
+    _Bool failed;
+    struct pending queue[];
+};
+
+static void *writer_loop_(void *arg) {
+    struct bitmap_writer *w = arg;
+    uint8_t *buffer = NULL;
+    size_t capacity = 0;
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while ((w->queued == 0) && !w->closing) {
+            pthread_cond_wait(&w->not_empty, &w->lock);
+        }
+        if (w->queued == 0) {
+            break;
+        }
+        struct pending p = w->queue[w->head];
+        pthread_mutex_unlock(&w->lock);
+        struct raw_bitmap_info rbi = get_raw_bitmap_info(p.bm);
+        struct probe pr;
+        probe_begin(&pr, PROBE_WRITE, w->written);
+        int r = write_bitmap_(p.bm, p.fname, w->rle, &buffer, &capacity);
+        probe_end(&pr, (size_t)rbi.width * rbi.height);
+        ++w->written;
+        destroy_raw_bitmap(p.bm);
+        free(p.fname);
+        pthread_mutex_lock(&w->lock);
+        w->head = (w->head + 1) % w->depth;
+        --w->queued;
+        if (r != 0) {
+            w->failed = 1;
+        }
+        pthread_cond_signal(&w->not_full);
+    }
+    pthread_mutex_unlock(&w->lock);
+    free(buffer);
+    return NULL;
+}
+
+struct bitmap_writer *create_bitmap_writer(size_t depth, _Bool rle) {
+    if (depth == 0) {
+        return NULL;
+    }
+    struct bitmap_writer *w = malloc(sizeof(*w) + depth * sizeof(struct pending));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->depth = depth;
+    w->head = 0;
+    w->queued = 0;
+    w->written = 0;
+    w->rle = rle;
+    w->closing = 0;
+    w->failed = 0;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    if (pthread_create(&w->thread, NULL, writer_loop_, w) != 0) {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->not_empty);
+        pthread_cond_destroy(&w->not_full);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int queue_bitmap(struct bitmap_writer *w, struct raw_bitmap *bm, const char *fname) {
+    char *name = (fname != NULL) ? strdup(fname) : NULL;
+    if ((w == NULL) || (bm == NULL) || (name == NULL)) {
+        destroy_raw_bitmap(bm);
+        free(name);
+        return -1;
+    }
+    pthread_mutex_lock(&w->lock);
+    while ((w->queued == w->depth) && !w->failed) {
+        pthread_cond_wait(&w->not_full, &w->lock);
+    }
+    if (w->failed) {
+        pthread_mutex_unlock(&w->lock);
+        destroy_raw_bitmap(bm);
+        free(name);
+        return -1;
+    }
+    struct pending *p = &w->queue[(w->head + w->queued) % w->depth];
+    p->bm = bm;
+    p->fname = name;
+    ++w->queued;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+int destroy_bitmap_writer(struct bitmap_writer *w) {
+    if (w == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    int r = w->failed ? -1 : 0;
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_cond_destroy(&w->not_full);
+    free(w);
+    return r;
+}
+
 static uint16_t read_16le(uint8_t *data, size_t *offset) {
     uint16_t res_low = data[*offset];
     ++*offset;
@@ -123,7 +494,7 @@ static void write_32le(uint8_t *data, size_t *offset, uint32_t val) {
     return;
 }
 
-static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap) {
+static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap, uint32_t *compression, size_t *bitmap_size) {
     if (data_size < 54) {
         return -1;
     }
@@ -134,29 +505,29 @@ static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap
         dprintf(2, "Invalid magic number, expecting 'BM'\n");
         return -1;
     }
-    dprintf(2, "Found expected magic number\n");
+    note("Found expected magic number\n");
     uint32_t check_size = read_32le(data, &offset);
     if (check_size != data_size) {
         dprintf(2, "Invalid file size, expecting %zu, got %" PRIu32 "\n", data_size, check_size);
         return -1;
     }
-    dprintf(2, "Bitmap file size is %" PRIu32 "\n", check_size);
+    note("Bitmap file size is %" PRIu32 "\n", check_size);
     (void)read_32le(data, &offset);
     uint32_t bitmap_array_offset = read_32le(data, &offset);
     if (bitmap_array_offset > data_size) {
         dprintf(2, "Bitmap starts beyond the file\n");
         return -1;
     }
-    dprintf(2, "Bitmap starts at offset %" PRIu32 "\n", bitmap_array_offset);
+    note("Bitmap starts at offset %" PRIu32 "\n", bitmap_array_offset);
     uint32_t header_size = read_32le(data, &offset);
     if (header_size != 40) {
         dprintf(2, "Header size is %" PRIu32 ", was expecting 40\n", header_size);
         return -1;
     }
     rbi->width = read_32le(data, &offset);
-    dprintf(2, "Image is %" PRIu32 " pixels wide\n", rbi->width);
+    note("Image is %" PRIu32 " pixels wide\n", rbi->width);
     rbi->height = read_32le(data, &offset);
-    dprintf(2, "Image is %" PRIu32 " pixels high\n", rbi->height);
+    note("Image is %" PRIu32 " pixels high\n", rbi->height);
     uint16_t planes = read_16le(data, &offset);
     if (planes != 1) {
         dprintf(2, "Unexpected number of planes: %" PRIu16 ", was expecting 1\n", planes);
@@ -175,22 +546,30 @@ static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap
             dprintf(2, "Unsupported bits per pixels (%" PRIu16 ")\n", rbi->bits_per_pixel);
             return -1;
     }
-    dprintf(2, "Bits per pixel: %" PRIu32 "\n", rbi->bits_per_pixel);
-    uint32_t compression = read_32le(data, &offset);
-    if (compression != 0) {
-        dprintf(2, "Non raw format (%" PRIu32 "), not supported\n", compression);
+    note("Bits per pixel: %" PRIu32 "\n", rbi->bits_per_pixel);
+    *compression = read_32le(data, &offset);
+    if (!((*compression == BI_RGB) || ((*compression == BI_RLE8) && (rbi->bits_per_pixel == 8)) || ((*compression == BI_RLE4) && (rbi->bits_per_pixel == 4)))) {
+        dprintf(2, "Non raw format (%" PRIu32 "), not supported\n", *compression);
         return -1;
     }
-    (void)read_32le(data, &offset);
-    uint32_t line_width = ((rbi->width * rbi->bits_per_pixel + 31) >> 5) << 2;
-    uint32_t theoretic_bitmap_size = line_width * rbi->height;
-    if ((theoretic_bitmap_size + bitmap_array_offset) > check_size) {
+    uint32_t image_size = read_32le(data, &offset);
+    if (*compression == BI_RGB) {
+        uint32_t line_width = ((rbi->width * rbi->bits_per_pixel + 31) >> 5) << 2;
+        image_size = line_width * rbi->height;
+    } else {
+        if (image_size == 0) {
+            image_size = check_size - bitmap_array_offset;
+        }
+        note("Run length encoded bitmap of %" PRIu32 " bytes\n", image_size);
+    }
+    if (((uint64_t)image_size + bitmap_array_offset) > check_size) {
         dprintf(2, "The bitmap overflows the file\n");
         return -1;
     }
+    *bitmap_size = image_size;
     rbi->w_ppm = read_32le(data, &offset);
     rbi->h_ppm = read_32le(data, &offset);
-    dprintf(2, "Width: %" PRIu32 " pixels per meter, Height: %" PRIu32 " pixels per meter\n", rbi->w_ppm, rbi->h_ppm);
+    note("Width: %" PRIu32 " pixels per meter, Height: %" PRIu32 " pixels per meter\n", rbi->w_ppm, rbi->h_ppm);
     rbi->colors_in_color_map = read_32le(data, &offset);
     (void)read_32le(data, &offset);
     if (rbi->bits_per_pixel <= 8) {
@@ -205,7 +584,7 @@ static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap
             return -1;
         }
     }
-    dprintf(2, "Using a color table of %" PRIu32 " colors\n", rbi->colors_in_color_map);
+    note("Using a color table of %" PRIu32 " colors\n", rbi->colors_in_color_map);
     size_t color_map_size = rbi->colors_in_color_map * sizeof(struct rgba);
     if (bitmap_array_offset < (color_map_size + offset)) {
         dprintf(2, "Colormap overflows to bitmap array\n");
@@ -216,7 +595,7 @@ static int parse_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap
     return 0;
 }
 
-static void dump_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap) {
+static void dump_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap_info *rbi, struct rgba **color_map, uint8_t **bitmap, uint32_t compression, uint32_t bitmap_size) {
     size_t offset = 0;
     /* Check the magic number */
     write_16le(data, &offset, UINT16_C(0x4d42));
@@ -229,8 +608,8 @@ static void dump_bitmap_info_(uint8_t *data, size_t data_size, struct raw_bitmap
     write_32le(data, &offset, rbi->height);
     write_16le(data, &offset, 1);
     write_16le(data, &offset, rbi->bits_per_pixel);
-    write_32le(data, &offset, 0);
-    write_32le(data, &offset, 0);
+    write_32le(data, &offset, compression);
+    write_32le(data, &offset, bitmap_size);
     write_32le(data, &offset, rbi->w_ppm);
     write_32le(data, &offset, rbi->h_ppm);
     write_32le(data, &offset, rbi->colors_in_color_map);
@@ -6,6 +6,23 @@
 
 struct raw_bitmap *disk_to_bitmap(const char *fname);
 
+/* Same as disk_to_bitmap on a file image held in memory, which is only read */
+struct raw_bitmap *memory_to_bitmap(const uint8_t *data, size_t data_size);
+
 int bitmap_to_disk(const struct raw_bitmap *bm, const char *fname);
 
+/* Same as bitmap_to_disk, palette bitmaps being stored as BI_RLE4 or BI_RLE8 */
+int bitmap_to_disk_rle(const struct raw_bitmap *bm, const char *fname);
+
+/* Writes bitmaps from a thread of its own, at most depth of them waiting, run length encoded with rle */
+struct bitmap_writer;
+
+struct bitmap_writer *create_bitmap_writer(size_t depth, _Bool rle);
+
+/* Hands bm over to the writer (it is destroyed once written), blocks while the queue is full, fails once a write has failed */
+int queue_bitmap(struct bitmap_writer *w, struct raw_bitmap *bm, const char *fname);
+
+/* Waits for the queued bitmaps to be written, returns -1 if any write failed */
+int destroy_bitmap_writer(struct bitmap_writer *w);
+
 #endif
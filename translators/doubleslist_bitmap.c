@@ -0,0 +1,149 @@
+#include "doubleslist_bitmap.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* Far enough out of any canvas, small enough for the error terms to fit in 64 bits */
+#define POLYLINE_LIMIT 268435456.0
+
+struct pen {
+    struct raw_bitmap *bm;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixel;
+    uint8_t *bytes;
+    size_t line_bytes;
+};
+
+static void plot_(const struct pen *p, int64_t x, int64_t y) {
+    if (p->bytes == NULL) {
+        (void)set_pixel(p->bm, x, y, p->pixel);
+        return;
+    }
+    /* Pixels are packed from the most significant bit of each byte */
+    uint8_t *byte = p->bytes + (size_t)y * p->line_bytes + (x >> 3);
+    uint8_t mask = 0x80 >> (x & 7);
+    if (p->pixel != 0) {
+        *byte |= mask;
+    } else {
+        *byte &= ~mask;
+    }
+    return;
+}
+
+/* Minor axis offset of the i-th pixel of a segment */
+static int64_t minor_(int64_t i, int64_t major_len, int64_t minor_len) {
+    return (2 * i * minor_len + major_len) / (2 * major_len);
+}
+
+/* First i of [lo, hi] with minor_(i) >= q, hi + 1 if none */
+static int64_t first_reaching_(int64_t lo, int64_t hi, int64_t major_len, int64_t minor_len, int64_t q) {
+    ++hi;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (minor_(mid, major_len, minor_len) >= q) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+static void draw_segment_(const struct pen *p, int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    int64_t dx = x1 - x0;
+    int64_t dy = y1 - y0;
+    _Bool steep = llabs(dy) > llabs(dx);
+    int64_t m0 = steep ? y0 : x0;
+    int64_t n0 = steep ? x0 : y0;
+    int64_t sm = ((steep ? dy : dx) < 0) ? -1 : 1;
+    int64_t sn = ((steep ? dx : dy) < 0) ? -1 : 1;
+    int64_t len = steep ? llabs(dy) : llabs(dx);
+    int64_t nlen = steep ? llabs(dx) : llabs(dy);
+    int64_t msize = steep ? p->height : p->width;
+    int64_t nsize = steep ? p->width : p->height;
+    if (len == 0) {
+        if ((x0 >= 0) && (x0 < p->width) && (y0 >= 0) && (y0 < p->height)) {
+            plot_(p, x0, y0);
+        }
+        return;
+    }
+    /* Clipping once per segment: the steps keeping both axes on the canvas form an interval */
+    int64_t lo = (sm > 0) ? -m0 : m0 - (msize - 1);
+    int64_t hi = (sm > 0) ? msize - 1 - m0 : m0;
+    lo = (lo > 0) ? lo : 0;
+    hi = (hi < len) ? hi : len;
+    if (lo > hi) {
+        return;
+    }
+    int64_t qlo = (sn > 0) ? -n0 : n0 - (nsize - 1);
+    int64_t qhi = (sn > 0) ? nsize - 1 - n0 : n0;
+    int64_t first = first_reaching_(lo, hi, len, nlen, qlo);
+    int64_t last = first_reaching_(lo, hi, len, nlen, qhi + 1) - 1;
+    if (first > last) {
+        return;
+    }
+    int64_t num = 2 * first * nlen + len;
+    int64_t q = num / (2 * len);
+    int64_t r = num % (2 * len);
+    for (int64_t i = first; i <= last; ++i) {
+        int64_t m = m0 + sm * i;
+        int64_t n = n0 + sn * q;
+        if (steep) {
+            plot_(p, n, m);
+        } else {
+            plot_(p, m, n);
+        }
+        r += 2 * nlen;
+        if (r >= 2 * len) {
+            r -= 2 * len;
+            ++q;
+        }
+    }
+    return;
+}
+
+static int64_t to_pixel_(double f, uint32_t size) {
+    f = floor(f * (double)size);
+    if (!(f > -POLYLINE_LIMIT)) {
+        return -POLYLINE_LIMIT;
+    }
+    if (f > POLYLINE_LIMIT) {
+        return POLYLINE_LIMIT;
+    }
+    return (int64_t)f;
+}
+
+int draw_polyline(struct raw_bitmap *bm, const struct doubles_list *dlx, const struct doubles_list *dly, uint32_t pixel) {
+    if ((bm == NULL) || (dlx == NULL) || (dly == NULL)) {
+        return -1;
+    }
+    size_t points_num = get_doubles_num(dlx);
+    if (get_doubles_num(dly) != points_num) {
+        return -1;
+    }
+    struct raw_bitmap_info rbi = get_raw_bitmap_info(bm);
+    struct pen p = {
+        .bm = bm,
+        .width = rbi.width,
+        .height = rbi.height,
+        .pixel = pixel,
+        .bytes = NULL,
+        .line_bytes = get_row_bytes_num(bm),
+    };
+    if ((rbi.bits_per_pixel == 1) && (pixel <= 1)) {
+        p.bytes = get_mutable_row_bytes(bm, 0);
+    }
+    const double *xs = get_doubles_array(dlx);
+    const double *ys = get_doubles_array(dly);
+    int result = 0;
+    for (size_t i = 0; i < points_num; ++i) {
+        size_t j = (i + 1 < points_num) ? i + 1 : 0;
+        int64_t x0 = to_pixel_(xs[i], rbi.width);
+        int64_t y0 = to_pixel_(ys[i], rbi.height);
+        if ((x0 < 0) || (x0 >= rbi.width) || (y0 < 0) || (y0 >= rbi.height)) {
+            ++result;
+        }
+        draw_segment_(&p, x0, y0, to_pixel_(xs[j], rbi.width), to_pixel_(ys[j], rbi.height));
+    }
+    return result;
+}
@@ -0,0 +1,14 @@
+#ifndef DOUBLESLIST_BITMAP_H_
+#define DOUBLESLIST_BITMAP_H_
+
+#include "../types/doubleslist.h"
+#include "../types/bitmap.h"
+
+/*
+ * Draws the closed polyline through the points (dlx[i] * width, dly[i] * height)
+ * with Bresenham segments clipped to the canvas, returns the number of points
+ * out of the canvas or -1 on error
+ */
+int draw_polyline(struct raw_bitmap *bm, const struct doubles_list *dlx, const struct doubles_list *dly, uint32_t pixel);
+
+#endif
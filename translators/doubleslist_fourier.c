@@ -1,7 +1,12 @@
 #include "doubleslist_fourier.h"
 #include <math.h>
+#include <complex.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "../types/fbase.h"
+#include "../types/fft.h"
+
+#define GRID_BLOCK 256
 
 double scalar_product(const struct doubles_list *dl, double (*base)(size_t,double), size_t mode) {
     if (dl == NULL) {
@@ -11,18 +16,45 @@ double scalar_product(const struct doubles_list *dl, double (*base)(size_t,doubl
     if (points == 0) {
         return 0.0;
     }
+    const double *w = get_doubles_array(dl);
+    double values[GRID_BLOCK];
     double integrate = 0.0;
-    double dt = 1.0 / (double)points;
-    double t = 0.0;
-    for (size_t i = 0; i < points; ++i) {
-        double w = get_double_from_doubles_list(dl, i);
-        integrate += w * base(mode, t);
-        t += dt;
+    for (size_t first = 0; first < points; first += GRID_BLOCK) {
+        size_t count = ((points - first) < GRID_BLOCK) ? (points - first) : GRID_BLOCK;
+        base_grid(base, mode, points, first, count, values);
+        for (size_t j = 0; j < count; ++j) {
+            integrate += w[first + j] * values[j];
+        }
     }
     integrate /= ((double)points);
     return integrate;
 }
 
+#define PHASOR_RENORMALISE 64
+
+/* Rotates a unit phasor by 2π.freq/points per sample instead of evaluating cos, its modulus is pulled back to 1 every PHASOR_RENORMALISE samples */
+static void add_fourier_vector_(double *f, size_t points, size_t mode, double k) {
+    size_t freq = ((mode + 1) / 2) % points;
+    double angle = 2.0 * M_PI * (double)freq / (double)points;
+    double wr = cos(angle);
+    double wi = sin(angle);
+    double zr = ((mode % 2) == 0) ? 0.0 : 1.0;
+    double zi = ((mode % 2) == 0) ? 1.0 : 0.0;
+    k *= sqrt(2.0);
+    for (size_t i = 0; i < points; ++i) {
+        f[i] += k * zr;
+        double tr = zr * wr - zi * wi;
+        zi = zr * wi + zi * wr;
+        zr = tr;
+        if ((i % PHASOR_RENORMALISE) == (PHASOR_RENORMALISE - 1)) {
+            double g = (3.0 - (zr * zr + zi * zi)) * 0.5;
+            zr *= g;
+            zi *= g;
+        }
+    }
+    return;
+}
+
 void add_base_vector(struct doubles_list *dl, double (*base)(size_t,double), size_t mode, double k) {
     if (dl == NULL) {
         return;
@@ -31,13 +63,255 @@ void add_base_vector(struct doubles_list *dl, double (*base)(size_t,double), siz
     if (points == 0) {
         return;
     }
+    double *f = get_mutable_doubles_array(dl);
+    if ((base == fourier) && (mode > 0)) {
+        add_fourier_vector_(f, points, mode, k);
+        return;
+    }
+    if (base == heaviside) {
+        size_t edges[3];
+        double h = k * heaviside_edges(mode, points, edges);
+        for (size_t i = edges[0]; i < edges[1]; ++i) {
+            f[i] -= h;
+        }
+        for (size_t i = edges[1]; i < edges[2]; ++i) {
+            f[i] += h;
+        }
+        return;
+    }
+    double values[GRID_BLOCK];
+    for (size_t first = 0; first < points; first += GRID_BLOCK) {
+        size_t count = ((points - first) < GRID_BLOCK) ? (points - first) : GRID_BLOCK;
+        base_grid(base, mode, points, first, count, values);
+        for (size_t j = 0; j < count; ++j) {
+            f[first + j] += k * values[j];
+        }
+    }
+    return;
+}
+
+static int fourier_coefficients_(const struct doubles_list *dl, struct doubles_list *coefs) {
+    size_t points = get_doubles_num(dl);
+    size_t modes = get_doubles_num(coefs);
+    struct real_fft_plan *plan = create_real_fft_plan(points);
+    double complex *spectrum = malloc((points / 2 + 1) * sizeof(*spectrum));
+    int r = -1;
+    if ((plan != NULL) && (spectrum != NULL)) {
+        r = real_fft_forward(plan, get_doubles_array(dl), spectrum);
+    }
+    if (r == 0) {
+        /* Mode 2k-1 is √2.cos(2πkt) and mode 2k is -√2.sin(2πkt) */
+        double k0 = sqrt(2.0) / (double)points;
+        for (size_t mode = 0; mode < modes; ++mode) {
+            if (mode == 0) {
+                set_double_from_doubles_list(coefs, mode, creal(spectrum[0]) / (double)points);
+                continue;
+            }
+            size_t freq = ((mode + 1) / 2) % points;
+            double complex x = (freq <= points / 2) ? spectrum[freq] : conj(spectrum[points - freq]);
+            double c = ((mode % 2) == 0) ? cimag(x) : creal(x);
+            set_double_from_doubles_list(coefs, mode, c * k0);
+        }
+    }
+    free(spectrum);
+    destroy_real_fft_plan(plan);
+    return r;
+}
+
+static int heaviside_coefficients_(const struct doubles_list *dl, struct doubles_list *coefs) {
+    size_t points = get_doubles_num(dl);
+    size_t modes = get_doubles_num(coefs);
+    double *sums = malloc((points + 1) * sizeof(*sums));
+    if (sums == NULL) {
+        return -1;
+    }
+    const double *w = get_doubles_array(dl);
+    sums[0] = 0.0;
+    for (size_t i = 0; i < points; ++i) {
+        sums[i + 1] = sums[i] + w[i];
+    }
+    for (size_t mode = 0; mode < modes; ++mode) {
+        size_t edges[3];
+        double k = heaviside_edges(mode, points, edges);
+        double c = (sums[edges[2]] - sums[edges[1]]) - (sums[edges[1]] - sums[edges[0]]);
+        set_double_from_doubles_list(coefs, mode, c * k / (double)points);
+    }
+    free(sums);
+    return 0;
+}
+
+static int legendre_coefficients_(const struct doubles_list *dl, struct doubles_list *coefs) {
+    size_t points = get_doubles_num(dl);
+    size_t modes = get_doubles_num(coefs);
+    double *values = malloc(2 * modes * sizeof(*values));
+    if (values == NULL) {
+        return -1;
+    }
+    double *integrate = values + modes;
+    for (size_t mode = 0; mode < modes; ++mode) {
+        integrate[mode] = 0.0;
+    }
+    const double *w = get_doubles_array(dl);
     double dt = 1.0 / (double)points;
-    double t = 0.0;
     for (size_t i = 0; i < points; ++i) {
-        double fi = get_double_from_doubles_list(dl, i);
-        fi += k * base(mode, t);
-        set_double_from_doubles_list(dl, i, fi);
-        t += dt;
+        legendre_values(modes, ((double)i) * dt, values);
+        for (size_t mode = 0; mode < modes; ++mode) {
+            integrate[mode] += w[i] * values[mode];
+        }
     }
-    return;
+    for (size_t mode = 0; mode < modes; ++mode) {
+        set_double_from_doubles_list(coefs, mode, integrate[mode] / (double)points);
+    }
+    free(values);
+    return 0;
+}
+
+int base_coefficients(const struct doubles_list *dl, double (*base)(size_t,double), struct doubles_list *coefs) {
+    if (dl == NULL) {
+        return -1;
+    }
+    if (coefs == NULL) {
+        return -1;
+    }
+    if (get_doubles_num(dl) == 0) {
+        return -1;
+    }
+    if (base == fourier) {
+        return fourier_coefficients_(dl, coefs);
+    }
+    if (base == heaviside) {
+        return heaviside_coefficients_(dl, coefs);
+    }
+    if (base == legendre) {
+        return legendre_coefficients_(dl, coefs);
+    }
+    size_t modes = get_doubles_num(coefs);
+    for (size_t mode = 0; mode < modes; ++mode) {
+        set_double_from_doubles_list(coefs, mode, scalar_product(dl, base, mode));
+    }
+    return 0;
+}
+
+static int add_heaviside_vectors_(struct doubles_list *dl, const struct doubles_list *coefs, size_t first_mode, size_t last_mode) {
+    size_t points = get_doubles_num(dl);
+    double *steps = calloc(points + 1, sizeof(*steps));
+    if (steps == NULL) {
+        return -1;
+    }
+    for (size_t mode = first_mode; mode <= last_mode; ++mode) {
+        size_t edges[3];
+        double h = get_double_from_doubles_list(coefs, mode) * heaviside_edges(mode, points, edges);
+        steps[edges[0]] -= h;
+        steps[edges[1]] += 2.0 * h;
+        steps[edges[2]] -= h;
+    }
+    double *f = get_mutable_doubles_array(dl);
+    double level = 0.0;
+    for (size_t i = 0; i < points; ++i) {
+        level += steps[i];
+        f[i] += level;
+    }
+    free(steps);
+    return 0;
+}
+
+static int add_legendre_vectors_(struct doubles_list *dl, const struct doubles_list *coefs, size_t first_mode, size_t last_mode) {
+    size_t points = get_doubles_num(dl);
+    double *values = malloc((last_mode + 1) * sizeof(*values));
+    if (values == NULL) {
+        return -1;
+    }
+    double *f = get_mutable_doubles_array(dl);
+    const double *c = get_doubles_array(coefs);
+    double dt = 1.0 / (double)points;
+    for (size_t i = 0; i < points; ++i) {
+        legendre_values(last_mode + 1, ((double)i) * dt, values);
+        double fi = f[i];
+        for (size_t mode = first_mode; mode <= last_mode; ++mode) {
+            fi += c[mode] * values[mode];
+        }
+        f[i] = fi;
+    }
+    free(values);
+    return 0;
+}
+
+static int add_fourier_vectors_(struct doubles_list *dl, const struct doubles_list *coefs, const struct fft_plan *plan, size_t first_mode, size_t last_mode) {
+    size_t points = get_doubles_num(dl);
+    double complex *spectrum = calloc(2 * points, sizeof(*spectrum));
+    if (spectrum == NULL) {
+        return -1;
+    }
+    /* f(i) = Re(sum(Z[k].exp(2iπki/points))), with Z[k] = √2.(c[2k-1] + i.c[2k]) */
+    double complex *samples = spectrum + points;
+    const double *c = get_doubles_array(coefs);
+    for (size_t mode = first_mode; mode <= last_mode; ++mode) {
+        if (mode == 0) {
+            spectrum[0] += c[0];
+            continue;
+        }
+        size_t freq = ((mode + 1) / 2) % points;
+        double k = c[mode] * sqrt(2.0);
+        spectrum[freq] += ((mode % 2) == 0) ? CMPLX(0.0, k) : CMPLX(k, 0.0);
+    }
+    int r = fft_backward(plan, spectrum, samples);
+    if (r == 0) {
+        double *f = get_mutable_doubles_array(dl);
+        for (size_t i = 0; i < points; ++i) {
+            f[i] += creal(samples[i]);
+        }
+    }
+    free(spectrum);
+    return r;
+}
+
+/* Above this many modes, one inverse FFT is cheaper than rotating a phasor per mode */
+static size_t fourier_ifft_threshold_(size_t points) {
+    size_t bits = 0;
+    while (points > 0) {
+        ++bits;
+        points >>= 1;
+    }
+    return 2 * bits;
+}
+
+int add_base_vectors(struct doubles_list *dl, double (*base)(size_t,double), const struct doubles_list *coefs, const struct fft_plan *plan, size_t first_mode, size_t last_mode) {
+    if (dl == NULL) {
+        return -1;
+    }
+    if (coefs == NULL) {
+        return -1;
+    }
+    if (last_mode >= get_doubles_num(coefs)) {
+        return -1;
+    }
+    if ((first_mode > last_mode) || (get_doubles_num(dl) == 0)) {
+        return 0;
+    }
+    size_t points = get_doubles_num(dl);
+    if ((base == fourier) && (plan != NULL) && (get_fft_points(plan) == points) && (last_mode - first_mode >= fourier_ifft_threshold_(points))) {
+        return add_fourier_vectors_(dl, coefs, plan, first_mode, last_mode);
+    }
+    if ((base == heaviside) && (last_mode - first_mode > 0)) {
+        return add_heaviside_vectors_(dl, coefs, first_mode, last_mode);
+    }
+    if (base == legendre) {
+        return add_legendre_vectors_(dl, coefs, first_mode, last_mode);
+    }
+    for (size_t mode = first_mode; mode <= last_mode; ++mode) {
+        add_base_vector(dl, base, mode, get_double_from_doubles_list(coefs, mode));
+    }
+    return 0;
+}
+
+int rebuild_from_coefficients(struct doubles_list *dl, double (*base)(size_t,double), const struct doubles_list *coefs, const struct fft_plan *plan, size_t last_mode) {
+    if (dl == NULL) {
+        return -1;
+    }
+    double *f = get_mutable_doubles_array(dl);
+    size_t points = get_doubles_num(dl);
+    for (size_t i = 0; i < points; ++i) {
+        f[i] = 0.0;
+    }
+    return add_base_vectors(dl, base, coefs, plan, 0, last_mode);
 }
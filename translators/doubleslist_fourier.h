@@ -2,9 +2,18 @@
 #define DOUBLESLIST_FOURIER_H_
 
 #include "../types/doubleslist.h"
+#include "../types/fft.h"
 
 double scalar_product(const struct doubles_list *dl, double (*base)(size_t,double), size_t mode);
 
 void add_base_vector(struct doubles_list *dl, double (*base)(size_t,double), size_t mode, double k);
 
+int base_coefficients(const struct doubles_list *dl, double (*base)(size_t,double), struct doubles_list *coefs);
+
+/* plan is built once by the caller for the number of points of dl; the fourier modes are added one by one without it */
+int add_base_vectors(struct doubles_list *dl, double (*base)(size_t,double), const struct doubles_list *coefs, const struct fft_plan *plan, size_t first_mode, size_t last_mode);
+
+/* Overwrites dl with the sum of the modes 0 to last_mode, independently of its previous content */
+int rebuild_from_coefficients(struct doubles_list *dl, double (*base)(size_t,double), const struct doubles_list *coefs, const struct fft_plan *plan, size_t last_mode);
+
 #endif
@@ -0,0 +1,78 @@
+#include "hilbertcycle.h"
+#include <stdlib.h>
+
+/* Spreads the 16 bits of x over the even bits of the result */
+static uint32_t interleave_(uint32_t x) {
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+/*
+ * The orientation of every sub-square is a prefix scan over the bit pairs of
+ * the coordinates, computed for all levels at once in 4 rounds of shifts.
+ */
+uint32_t hilbert_index(const struct point *pt) {
+    uint32_t x = pt->x;
+    uint32_t y = pt->y;
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+    uint32_t ra = a | (b >> 1);
+    uint32_t rb = (a >> 1) ^ a;
+    uint32_t rc = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t rd = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+    for (unsigned int shift = 2; shift < 16; shift <<= 1) {
+        a = ra;
+        b = rb;
+        c = rc;
+        d = rd;
+        if (shift < 8) {
+            ra = (a & (a >> shift)) ^ (b & (b >> shift));
+            rb = (a & (b >> shift)) ^ (b & ((a ^ b) >> shift));
+        }
+        rc ^= (a & (c >> shift)) ^ (b & (d >> shift));
+        rd ^= (b & (c >> shift)) ^ ((a ^ b) & (d >> shift));
+    }
+    a = rc ^ (rc >> 1);
+    b = rd ^ (rd >> 1);
+    uint32_t i0 = x ^ y;
+    uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+    return (interleave_(i1) << 1) | interleave_(i0);
+}
+
+static int compare_keys_(const void *a, const void *b) {
+    uint64_t ka = *(const uint64_t *)a;
+    uint64_t kb = *(const uint64_t *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+struct points_list *hilbert_cycle(const struct points_list *l) {
+    size_t points_num = get_points_num(l);
+    if (points_num < 1) {
+        return NULL;
+    }
+    uint64_t *keys = malloc(points_num * sizeof(uint64_t));
+    if (keys == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < points_num; ++i) {
+        struct point pt;
+        (void)get_point_from_points_list(l, i, &pt);
+        keys[i] = ((uint64_t)hilbert_index(&pt) << 32) | i;
+    }
+    qsort(keys, points_num, sizeof(uint64_t), compare_keys_);
+    struct points_list *res = create_points_list(points_num);
+    if (res != NULL) {
+        for (size_t i = 0; i < points_num; ++i) {
+            struct point pt;
+            (void)get_point_from_points_list(l, keys[i] & UINT32_MAX, &pt);
+            (void)set_point_from_points_list(res, i, &pt);
+        }
+    }
+    free(keys);
+    return res;
+}
@@ -0,0 +1,12 @@
+#ifndef HILBERT_CYCLE_H_
+#define HILBERT_CYCLE_H_
+
+#include "../types/pointslist.h"
+
+/* Index of the point along the Hilbert curve filling the 65536 x 65536 square */
+uint32_t hilbert_index(const struct point *pt);
+
+/* Same contract as short_cycle, the points being visited along the Hilbert curve, in O(n.log(n)) */
+struct points_list *hilbert_cycle(const struct points_list *l);
+
+#endif
@@ -1,6 +1,14 @@
 #include "shortcycle.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+
+#define BORUVKA_MAX_THREADS 256
+#define TOUR_EPSILON 1e-9
+#define TOUR_CLOCK_PERIOD 64
 
 struct edge {
     uint32_t src;
@@ -8,7 +16,7 @@ struct edge {
     uint32_t square_dist;
 };
 
-struct complete_graph {
+struct graph {
     size_t points_num;
     size_t edges_num;
     struct edge edges[];
@@ -24,13 +32,30 @@ static uint32_t sqd(const struct point *pi, const struct point *pj) {
     return dx * dx + dy * dy;
 }
 
-static struct complete_graph *get_complete_graph_(const struct points_list *pl) {
+static void push_edge_(struct graph *cg, uint32_t src, uint32_t dst, uint32_t sd) {
+    size_t sub = cg->edges_num;
+    while (sub > 0) {
+        size_t x = (sub - 1) / 2;
+        if (cg->edges[x].square_dist < sd) {
+            break;
+        }
+        cg->edges[sub] = cg->edges[x];
+        sub = x;
+    }
+    cg->edges[sub].src = src;
+    cg->edges[sub].dst = dst;
+    cg->edges[sub].square_dist = sd;
+    ++cg->edges_num;
+    return;
+}
+
+static struct graph *get_complete_graph_(const struct points_list *pl) {
     size_t points_num = get_points_num(pl);
     if (points_num < 1) {
         return NULL;
     }
     size_t edges_num = ((points_num - 1) * points_num) / 2;
-    struct complete_graph *cg = malloc(sizeof(*cg) + edges_num * sizeof(struct edge));
+    struct graph *cg = malloc(sizeof(*cg) + edges_num * sizeof(struct edge));
     if (cg == NULL) {
         return NULL;
     }
@@ -42,26 +67,13 @@ static struct complete_graph *get_complete_graph_(const struct points_list *pl)
         for (size_t j = i + 1; j < points_num; ++j) {
             struct point pj;
             get_point_from_points_list(pl, j, &pj);
-            uint32_t sd = sqd(&pi, &pj);
-            size_t sub = cg->edges_num;
-            while (sub > 0) {
-                size_t x = (sub - 1) / 2;
-                if (cg->edges[x].square_dist < sd) {
-                    break;
-                }
-                cg->edges[sub] = cg->edges[x];
-                sub = x;
-            }
-            cg->edges[sub].src = i;
-            cg->edges[sub].dst = j;
-            cg->edges[sub].square_dist = sd;
-            ++cg->edges_num;
+            push_edge_(cg, i, j, sqd(&pi, &pj));
         }
     }
     return cg;
 }
 
-static int pop_shortest_edge_(struct complete_graph *cg, struct edge *edg) {
+static int pop_shortest_edge_(struct graph *cg, struct edge *edg) {
     if (cg->edges_num <= 0) {
         return -1;
     }
@@ -106,6 +118,495 @@ static int pop_shortest_edge_(struct complete_graph *cg, struct edge *edg) {
     return 0;
 }
 
+struct grid {
+    uint16_t min_x;
+    uint16_t min_y;
+    unsigned int shift;
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t *starts;
+    uint32_t *order;
+};
+
+static void destroy_grid_(struct grid *g) {
+    free(g->starts);
+    free(g->order);
+    g->starts = NULL;
+    g->order = NULL;
+    return;
+}
+
+static size_t grid_cell_(const struct grid *g, const struct point *pt) {
+    size_t cx = (pt->x - g->min_x) >> g->shift;
+    size_t cy = (pt->y - g->min_y) >> g->shift;
+    return cy * g->columns + cx;
+}
+
+/* Buckets the points in square cells holding about two points each */
+static int build_grid_(struct grid *g, const struct point *pts, size_t points_num) {
+    uint16_t max_x = 0;
+    uint16_t max_y = 0;
+    g->min_x = UINT16_MAX;
+    g->min_y = UINT16_MAX;
+    for (size_t i = 0; i < points_num; ++i) {
+        g->min_x = (pts[i].x < g->min_x) ? pts[i].x : g->min_x;
+        g->min_y = (pts[i].y < g->min_y) ? pts[i].y : g->min_y;
+        max_x = (pts[i].x > max_x) ? pts[i].x : max_x;
+        max_y = (pts[i].y > max_y) ? pts[i].y : max_y;
+    }
+    uint64_t area = ((uint64_t)(max_x - g->min_x) + 1) * ((uint64_t)(max_y - g->min_y) + 1);
+    g->shift = 0;
+    while ((((uint64_t)1 << (2 * g->shift)) * points_num) < 2 * area) {
+        ++g->shift;
+    }
+    g->columns = ((max_x - g->min_x) >> g->shift) + 1;
+    g->rows = ((max_y - g->min_y) >> g->shift) + 1;
+    size_t cells = (size_t)g->columns * g->rows;
+    g->starts = calloc(cells + 1, sizeof(uint32_t));
+    g->order = malloc(points_num * sizeof(uint32_t));
+    if ((g->starts == NULL) || (g->order == NULL)) {
+        destroy_grid_(g);
+        return -1;
+    }
+    for (size_t i = 0; i < points_num; ++i) {
+        ++g->starts[grid_cell_(g, &pts[i]) + 1];
+    }
+    for (size_t c = 0; c < cells; ++c) {
+        g->starts[c + 1] += g->starts[c];
+    }
+    for (size_t i = 0; i < points_num; ++i) {
+        g->order[g->starts[grid_cell_(g, &pts[i])]++] = i;
+    }
+    for (size_t c = cells; c > 0; --c) {
+        g->starts[c] = g->starts[c - 1];
+    }
+    g->starts[0] = 0;
+    return 0;
+}
+
+struct search {
+    const struct point *pts;
+    const uint32_t *comp;
+    uint32_t from;
+    size_t wanted;
+    size_t found;
+    uint32_t *idx;
+    uint32_t *sqd;
+};
+
+/* Candidates are ordered by square distance, then by index, so that searches are deterministic */
+static void consider_(struct search *se, uint32_t j) {
+    if (j == se->from) {
+        return;
+    }
+    if ((se->comp != NULL) && (se->comp[j] == se->comp[se->from])) {
+        return;
+    }
+    uint32_t d = sqd(&se->pts[se->from], &se->pts[j]);
+    if (se->found == se->wanted) {
+        size_t last = se->found - 1;
+        if ((d > se->sqd[last]) || ((d == se->sqd[last]) && (j >= se->idx[last]))) {
+            return;
+        }
+    }
+    size_t slot = (se->found < se->wanted) ? se->found++ : se->found - 1;
+    while ((slot > 0) && ((se->sqd[slot - 1] > d) || ((se->sqd[slot - 1] == d) && (se->idx[slot - 1] > j)))) {
+        se->sqd[slot] = se->sqd[slot - 1];
+        se->idx[slot] = se->idx[slot - 1];
+        --slot;
+    }
+    se->sqd[slot] = d;
+    se->idx[slot] = j;
+    return;
+}
+
+/* Scans rings of cells around the point until no farther ring can hold a point within bound or closer than the wanted-th found one */
+static void search_grid_(const struct grid *g, struct search *se, uint64_t bound) {
+    const struct point *pt = &se->pts[se->from];
+    int64_t cx = (pt->x - g->min_x) >> g->shift;
+    int64_t cy = (pt->y - g->min_y) >> g->shift;
+    uint64_t cell = UINT64_C(1) << g->shift;
+    uint32_t last_ring = (g->columns > g->rows) ? g->columns : g->rows;
+    for (uint32_t r = 0; r <= last_ring; ++r) {
+        if (r > 0) {
+            uint64_t limit = bound;
+            if ((se->found == se->wanted) && (se->sqd[se->found - 1] < limit)) {
+                limit = se->sqd[se->found - 1];
+            }
+            uint64_t reach = (r - 1) * cell + 1;
+            if (reach * reach > limit) {
+                return;
+            }
+        }
+        for (int64_t y = cy - r; y <= cy + r; ++y) {
+            if ((y < 0) || (y >= g->rows)) {
+                continue;
+            }
+            int64_t step = ((r == 0) || (y == cy - r) || (y == cy + r)) ? 1 : 2 * (int64_t)r;
+            for (int64_t x = cx - r; x <= cx + r; x += step) {
+                if ((x < 0) || (x >= g->columns)) {
+                    continue;
+                }
+                size_t c = (size_t)y * g->columns + x;
+                for (uint32_t k = g->starts[c]; k < g->starts[c + 1]; ++k) {
+                    consider_(se, g->order[k]);
+                }
+            }
+        }
+    }
+    return;
+}
+
+static uint32_t find_root_(_Atomic uint32_t *parent, uint32_t i) {
+    uint32_t p = atomic_load(&parent[i]);
+    while (p != i) {
+        i = p;
+        p = atomic_load(&parent[i]);
+    }
+    return i;
+}
+
+/* Lock-free union, the larger root is linked under the smaller one, returns 0 if both were already joined */
+static int unite_(_Atomic uint32_t *parent, uint32_t a, uint32_t b) {
+    while (1) {
+        a = find_root_(parent, a);
+        b = find_root_(parent, b);
+        if (a == b) {
+            return 0;
+        }
+        if (a > b) {
+            uint32_t tmp = a;
+            a = b;
+            b = tmp;
+        }
+        uint32_t expected = b;
+        if (atomic_compare_exchange_weak(&parent[b], &expected, a)) {
+            return 1;
+        }
+    }
+}
+
+static void atomic_min64_(_Atomic uint64_t *x, uint64_t v) {
+    uint64_t cur = atomic_load(x);
+    while ((v < cur) && !atomic_compare_exchange_weak(x, &cur, v)) {
+    }
+    return;
+}
+
+static void atomic_min32_(_Atomic uint32_t *x, uint32_t v) {
+    uint32_t cur = atomic_load(x);
+    while ((v < cur) && !atomic_compare_exchange_weak(x, &cur, v)) {
+    }
+    return;
+}
+
+static _Bool has_neighbour_(const uint32_t *idx, size_t neighbours, uint32_t j) {
+    for (size_t k = 0; k < neighbours; ++k) {
+        if (idx[k] == j) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Borůvka rounds: every component picks its shortest outgoing edge, edges being
+ * totally ordered by (square distance, lower end, higher end), which makes the
+ * picked edges a forest whatever the number of threads.
+ */
+struct boruvka {
+    const struct grid *g;
+    const struct point *pts;
+    _Atomic uint32_t *parent;
+    uint32_t *comp;
+    uint32_t *near_idx;
+    uint32_t *near_sqd;
+    _Atomic uint64_t *best;
+    _Atomic uint32_t *best_high;
+    struct edge *tree;
+    _Atomic size_t tree_num;
+    _Atomic size_t components;
+};
+
+struct boruvka_task {
+    struct boruvka *b;
+    void (*phase)(struct boruvka *b, size_t first, size_t last);
+    size_t first;
+    size_t last;
+};
+
+static void label_phase_(struct boruvka *b, size_t first, size_t last) {
+    size_t roots = 0;
+    for (size_t i = first; i < last; ++i) {
+        b->comp[i] = find_root_(b->parent, i);
+        atomic_store(&b->parent[i], b->comp[i]);
+        if (b->comp[i] == i) {
+            ++roots;
+        }
+        atomic_store(&b->best[i], UINT64_MAX);
+        atomic_store(&b->best_high[i], UINT32_MAX);
+    }
+    atomic_fetch_add(&b->components, roots);
+    return;
+}
+
+static uint64_t near_key_(const struct boruvka *b, uint32_t i) {
+    uint32_t j = b->near_idx[i];
+    return (((uint64_t)b->near_sqd[i]) << 32) | ((i < j) ? i : j);
+}
+
+static void nearest_phase_(struct boruvka *b, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        struct search se = {
+            .pts = b->pts,
+            .comp = b->comp,
+            .from = i,
+            .wanted = 1,
+            .found = 0,
+            .idx = &b->near_idx[i],
+            .sqd = &b->near_sqd[i],
+        };
+        search_grid_(b->g, &se, atomic_load(&b->best[b->comp[i]]) >> 32);
+        if (se.found == 0) {
+            b->near_idx[i] = i;
+            continue;
+        }
+        atomic_min64_(&b->best[b->comp[i]], near_key_(b, i));
+    }
+    return;
+}
+
+static void tie_phase_(struct boruvka *b, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        uint32_t j = b->near_idx[i];
+        if (j == i) {
+            continue;
+        }
+        if (near_key_(b, i) == atomic_load(&b->best[b->comp[i]])) {
+            atomic_min32_(&b->best_high[b->comp[i]], (i < j) ? j : i);
+        }
+    }
+    return;
+}
+
+static void merge_phase_(struct boruvka *b, size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+        uint64_t key = atomic_load(&b->best[i]);
+        if ((b->comp[i] != i) || (key == UINT64_MAX)) {
+            continue;
+        }
+        uint32_t low = key & UINT32_MAX;
+        uint32_t high = atomic_load(&b->best_high[i]);
+        if (unite_(b->parent, low, high)) {
+            size_t slot = atomic_fetch_add(&b->tree_num, 1);
+            b->tree[slot].src = low;
+            b->tree[slot].dst = high;
+            b->tree[slot].square_dist = key >> 32;
+        }
+    }
+    return;
+}
+
+static void *run_task_(void *arg) {
+    struct boruvka_task *task = arg;
+    task->phase(task->b, task->first, task->last);
+    return NULL;
+}
+
+static void run_parallel_(struct boruvka *b, void (*phase)(struct boruvka *b, size_t first, size_t last), size_t points_num, size_t threads) {
+    struct boruvka_task tasks[BORUVKA_MAX_THREADS];
+    pthread_t ids[BORUVKA_MAX_THREADS];
+    int started[BORUVKA_MAX_THREADS];
+    size_t chunk = (points_num + threads - 1) / threads;
+    for (size_t t = 0; t < threads; ++t) {
+        tasks[t].b = b;
+        tasks[t].phase = phase;
+        tasks[t].first = (t * chunk < points_num) ? t * chunk : points_num;
+        tasks[t].last = ((t + 1) * chunk < points_num) ? (t + 1) * chunk : points_num;
+        started[t] = (t > 0) && (pthread_create(&ids[t], NULL, run_task_, &tasks[t]) == 0);
+    }
+    for (size_t t = 0; t < threads; ++t) {
+        if (!started[t]) {
+            run_task_(&tasks[t]);
+        }
+    }
+    for (size_t t = 1; t < threads; ++t) {
+        if (started[t]) {
+            pthread_join(ids[t], NULL);
+        }
+    }
+    return;
+}
+
+static int compare_edges_(const void *a, const void *b) {
+    const struct edge *ea = a;
+    const struct edge *eb = b;
+    if (ea->square_dist != eb->square_dist) {
+        return (ea->square_dist > eb->square_dist) - (ea->square_dist < eb->square_dist);
+    }
+    if (ea->src != eb->src) {
+        return (ea->src > eb->src) - (ea->src < eb->src);
+    }
+    return (ea->dst > eb->dst) - (ea->dst < eb->dst);
+}
+
+/* Joins the components of parent with the shortest edges between them, until a single component is left */
+static int boruvka_(struct graph *cg, const struct grid *g, const struct point *pts, _Atomic uint32_t *parent, size_t threads) {
+    size_t points_num = cg->points_num;
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > BORUVKA_MAX_THREADS) {
+        threads = BORUVKA_MAX_THREADS;
+    }
+    struct boruvka b = {
+        .g = g,
+        .pts = pts,
+        .parent = parent,
+        .comp = malloc(points_num * sizeof(uint32_t)),
+        .near_idx = malloc(points_num * sizeof(uint32_t)),
+        .near_sqd = malloc(points_num * sizeof(uint32_t)),
+        .best = malloc(points_num * sizeof(_Atomic uint64_t)),
+        .best_high = malloc(points_num * sizeof(_Atomic uint32_t)),
+        .tree = malloc(points_num * sizeof(struct edge)),
+    };
+    atomic_init(&b.tree_num, 0);
+    int r = 0;
+    if ((b.comp == NULL) || (b.near_idx == NULL) || (b.near_sqd == NULL) || (b.best == NULL) || (b.best_high == NULL) || (b.tree == NULL)) {
+        r = -1;
+    }
+    while (r == 0) {
+        atomic_store(&b.components, 0);
+        run_parallel_(&b, label_phase_, points_num, threads);
+        if (atomic_load(&b.components) <= 1) {
+            break;
+        }
+        size_t tree_num = atomic_load(&b.tree_num);
+        run_parallel_(&b, nearest_phase_, points_num, threads);
+        run_parallel_(&b, tie_phase_, points_num, threads);
+        run_parallel_(&b, merge_phase_, points_num, threads);
+        if (atomic_load(&b.tree_num) == tree_num) {
+            r = -1;
+        }
+    }
+    if (r == 0) {
+        /* Slots are taken in the order the threads merge, the graph needs the edges in the same order for any thread count */
+        size_t tree_num = atomic_load(&b.tree_num);
+        qsort(b.tree, tree_num, sizeof(struct edge), compare_edges_);
+        for (size_t k = 0; k < tree_num; ++k) {
+            push_edge_(cg, b.tree[k].src, b.tree[k].dst, b.tree[k].square_dist);
+        }
+    }
+    free(b.comp);
+    free(b.near_idx);
+    free(b.near_sqd);
+    free(b.best);
+    free(b.best_high);
+    free(b.tree);
+    return r;
+}
+
+static int load_points_(const struct points_list *pl, struct point **pts, _Atomic uint32_t **parent, struct grid *g) {
+    size_t points_num = get_points_num(pl);
+    *pts = malloc(points_num * sizeof(**pts));
+    *parent = malloc(points_num * sizeof(**parent));
+    if ((*pts == NULL) || (*parent == NULL)) {
+        return -1;
+    }
+    for (size_t i = 0; i < points_num; ++i) {
+        get_point_from_points_list(pl, i, &(*pts)[i]);
+        atomic_init(&(*parent)[i], i);
+    }
+    return build_grid_(g, *pts, points_num);
+}
+
+/* Keeps the edges to the k nearest neighbours of each point, plus the shortest edges joining the components they leave apart */
+static struct graph *get_sparse_graph_(const struct points_list *pl, size_t neighbours) {
+    size_t points_num = get_points_num(pl);
+    if (points_num < 1) {
+        return NULL;
+    }
+    if (neighbours > points_num - 1) {
+        neighbours = points_num - 1;
+    }
+    struct graph *cg = malloc(sizeof(*cg) + (points_num * neighbours + points_num) * sizeof(struct edge));
+    uint32_t *idx = malloc(points_num * neighbours * sizeof(uint32_t) + 1);
+    uint32_t *dist = malloc(points_num * neighbours * sizeof(uint32_t) + 1);
+    struct point *pts = NULL;
+    _Atomic uint32_t *parent = NULL;
+    struct grid g = { 0 };
+    int r = -1;
+    if ((cg != NULL) && (idx != NULL) && (dist != NULL)) {
+        r = load_points_(pl, &pts, &parent, &g);
+    }
+    if (r == 0) {
+        cg->points_num = points_num;
+        cg->edges_num = 0;
+        for (size_t i = 0; i < points_num; ++i) {
+            struct search se = {
+                .pts = pts,
+                .comp = NULL,
+                .from = i,
+                .wanted = neighbours,
+                .found = 0,
+                .idx = idx + i * neighbours,
+                .sqd = dist + i * neighbours,
+            };
+            search_grid_(&g, &se, UINT64_MAX);
+        }
+        for (size_t i = 0; i < points_num; ++i) {
+            for (size_t k = 0; k < neighbours; ++k) {
+                uint32_t j = idx[i * neighbours + k];
+                if ((j < i) && has_neighbour_(idx + j * neighbours, neighbours, i)) {
+                    continue;
+                }
+                push_edge_(cg, i, j, dist[i * neighbours + k]);
+                (void)unite_(parent, i, j);
+            }
+        }
+        r = boruvka_(cg, &g, pts, parent, 1);
+    }
+    destroy_grid_(&g);
+    free(pts);
+    free(parent);
+    free(idx);
+    free(dist);
+    if (r != 0) {
+        free(cg);
+        return NULL;
+    }
+    return cg;
+}
+
+/* Minimum spanning tree of the complete graph, without materialising its edges */
+static struct graph *get_tree_graph_(const struct points_list *pl, size_t threads) {
+    size_t points_num = get_points_num(pl);
+    if (points_num < 1) {
+        return NULL;
+    }
+    struct graph *cg = malloc(sizeof(*cg) + points_num * sizeof(struct edge));
+    struct point *pts = NULL;
+    _Atomic uint32_t *parent = NULL;
+    struct grid g = { 0 };
+    int r = -1;
+    if (cg != NULL) {
+        r = load_points_(pl, &pts, &parent, &g);
+    }
+    if (r == 0) {
+        cg->points_num = points_num;
+        cg->edges_num = 0;
+        r = boruvka_(cg, &g, pts, parent, threads);
+    }
+    destroy_grid_(&g);
+    free(pts);
+    free(parent);
+    if (r != 0) {
+        free(cg);
+        return NULL;
+    }
+    return cg;
+}
+
 struct step {
     uint32_t ptref;
     uint32_t root;
@@ -152,7 +653,7 @@ static void add_edge_to_cycles_(struct cycles *c, const struct edge *edg) {
     return;
 }
 
-static struct cycles *get_cycle_(struct complete_graph *cg) {
+static struct cycles *get_cycle_(struct graph *cg) {
     if (cg->points_num < 1) {
         return NULL;
     }
@@ -171,9 +672,11 @@ static struct cycles *get_cycle_(struct complete_graph *cg) {
     }
     while (cy->steps_num < steps_num) {
         struct edge edg;
-        if (pop_shortest_edge_(cg, &edg) == 0) {
-            add_edge_to_cycles_(cy, &edg);
+        if (pop_shortest_edge_(cg, &edg) != 0) {
+            free(cy);
+            return NULL;
         }
+        add_edge_to_cycles_(cy, &edg);
     }
     return cy;
 }
@@ -210,11 +713,7 @@ static struct points_list *link_points_(const struct cycles *cy, const struct po
     return res;
 }
 
-struct points_list *short_cycle(const struct points_list *l) {
-    struct complete_graph *cg = get_complete_graph_(l);
-    if (cg == NULL) {
-        return NULL;
-    }
+static struct points_list *graph_to_cycle_(struct graph *cg, const struct points_list *l) {
     struct cycles *cy = get_cycle_(cg);
     free(cg);
     if (cy == NULL) {
@@ -224,3 +723,341 @@ struct points_list *short_cycle(const struct points_list *l) {
     free(cy);
     return result;
 }
+
+struct points_list *short_cycle(const struct points_list *l) {
+    struct graph *cg = get_complete_graph_(l);
+    if (cg == NULL) {
+        return NULL;
+    }
+    return graph_to_cycle_(cg, l);
+}
+
+struct points_list *sparse_short_cycle(const struct points_list *l, size_t neighbours) {
+    struct graph *cg = get_sparse_graph_(l, neighbours);
+    if (cg == NULL) {
+        return NULL;
+    }
+    return graph_to_cycle_(cg, l);
+}
+
+struct points_list *parallel_short_cycle(const struct points_list *l, size_t threads) {
+    struct graph *cg = get_tree_graph_(l, threads);
+    if (cg == NULL) {
+        return NULL;
+    }
+    return graph_to_cycle_(cg, l);
+}
+
+struct tour {
+    size_t points_num;
+    const struct point *pts;
+    uint32_t *order;
+    uint32_t *pos;
+    uint32_t *queue;
+    _Bool *queued;
+    size_t head;
+    size_t queued_num;
+};
+
+static double dist_(const struct tour *t, uint32_t a, uint32_t b) {
+    return sqrt((double)sqd(&t->pts[a], &t->pts[b]));
+}
+
+static uint32_t succ_(const struct tour *t, uint32_t a) {
+    size_t p = t->pos[a] + 1;
+    return t->order[(p == t->points_num) ? 0 : p];
+}
+
+static uint32_t pred_(const struct tour *t, uint32_t a) {
+    size_t p = t->pos[a];
+    return t->order[(p == 0) ? t->points_num - 1 : p - 1];
+}
+
+static void place_(struct tour *t, size_t p, uint32_t a) {
+    t->order[p] = a;
+    t->pos[a] = p;
+    return;
+}
+
+/* Clears the don't-look bit of a point */
+static void push_active_(struct tour *t, uint32_t a) {
+    if (t->queued[a]) {
+        return;
+    }
+    t->queued[a] = 1;
+    t->queue[(t->head + t->queued_num) % t->points_num] = a;
+    ++t->queued_num;
+    return;
+}
+
+static int pop_active_(struct tour *t, uint32_t *a) {
+    if (t->queued_num == 0) {
+        return -1;
+    }
+    *a = t->queue[t->head];
+    t->queued[*a] = 0;
+    t->head = (t->head + 1) % t->points_num;
+    --t->queued_num;
+    return 0;
+}
+
+/* Reverses the path from position i to position j, or its complement when shorter, both giving the same cycle */
+static void reverse_(struct tour *t, size_t i, size_t j) {
+    size_t n = t->points_num;
+    size_t len = (j + n - i) % n + 1;
+    if (2 * len > n) {
+        size_t tmp = (j + 1) % n;
+        j = (i + n - 1) % n;
+        i = tmp;
+        len = n - len;
+    }
+    for (size_t k = 0; k < len / 2; ++k) {
+        uint32_t a = t->order[i];
+        place_(t, i, t->order[j]);
+        place_(t, j, a);
+        i = (i + 1 == n) ? 0 : i + 1;
+        j = (j == 0) ? n - 1 : j - 1;
+    }
+    return;
+}
+
+/* Moves the len points starting at position i right after position q, shifting whichever side of the cycle is shorter */
+static void move_segment_(struct tour *t, size_t i, size_t len, size_t q, _Bool reversed) {
+    size_t n = t->points_num;
+    uint32_t seg[3];
+    for (size_t k = 0; k < len; ++k) {
+        seg[k] = t->order[(i + k) % n];
+    }
+    size_t forward = (q + n - (i + len - 1) % n) % n;
+    size_t backward = (i + n - 1 - q) % n;
+    size_t base;
+    if (forward <= backward) {
+        for (size_t k = 0; k < forward; ++k) {
+            place_(t, (i + k) % n, t->order[(i + len + k) % n]);
+        }
+        base = (i + forward) % n;
+    } else {
+        for (size_t k = backward; k > 0; --k) {
+            place_(t, (q + len + k) % n, t->order[(q + k) % n]);
+        }
+        base = (q + 1) % n;
+    }
+    for (size_t k = 0; k < len; ++k) {
+        place_(t, (base + k) % n, reversed ? seg[len - 1 - k] : seg[k]);
+    }
+    return;
+}
+
+static _Bool in_segment_(const struct tour *t, size_t i, size_t len, uint32_t a) {
+    return ((t->pos[a] + t->points_num - i) % t->points_num) < len;
+}
+
+/* Replaces edges (a,b) and (c,d) by (a,c) and (b,d), c being among the neighbours of a closer than b */
+static _Bool two_opt_(struct tour *t, uint32_t a, const uint32_t *near, size_t neighbours) {
+    for (int dir = 0; dir < 2; ++dir) {
+        uint32_t b = dir ? pred_(t, a) : succ_(t, a);
+        double dab = dist_(t, a, b);
+        for (size_t k = 0; k < neighbours; ++k) {
+            uint32_t c = near[k];
+            double dac = dist_(t, a, c);
+            if (dac >= dab) {
+                break;
+            }
+            uint32_t d = dir ? pred_(t, c) : succ_(t, c);
+            if ((c == b) || (d == a)) {
+                continue;
+            }
+            if (dab + dist_(t, c, d) - dac - dist_(t, b, d) > TOUR_EPSILON) {
+                if (dir == 0) {
+                    reverse_(t, t->pos[b], t->pos[c]);
+                } else {
+                    reverse_(t, t->pos[a], t->pos[d]);
+                }
+                push_active_(t, a);
+                push_active_(t, b);
+                push_active_(t, c);
+                push_active_(t, d);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Moves the path of 1 to 3 points starting at a next to one of the neighbours of a */
+static _Bool or_opt_(struct tour *t, uint32_t a, const uint32_t *near, size_t neighbours) {
+    size_t n = t->points_num;
+    for (size_t len = 1; len <= 3; ++len) {
+        size_t i = t->pos[a];
+        uint32_t s2 = t->order[(i + len - 1) % n];
+        uint32_t p = pred_(t, a);
+        uint32_t q = succ_(t, s2);
+        double removed = dist_(t, p, a) + dist_(t, s2, q) - dist_(t, p, q);
+        if (removed <= TOUR_EPSILON) {
+            continue;
+        }
+        for (size_t k = 0; k < neighbours; ++k) {
+            uint32_t c = near[k];
+            double dac = dist_(t, a, c);
+            if (dac >= removed) {
+                break;
+            }
+            if (in_segment_(t, i, len, c)) {
+                continue;
+            }
+            uint32_t e = succ_(t, c);
+            uint32_t f = pred_(t, c);
+            _Bool after = !in_segment_(t, i, len, e) && (removed - (dac + dist_(t, s2, e) - dist_(t, c, e)) > TOUR_EPSILON);
+            _Bool before = !after && !in_segment_(t, i, len, f) && (removed - (dac + dist_(t, s2, f) - dist_(t, f, c)) > TOUR_EPSILON);
+            if (!after && !before) {
+                continue;
+            }
+            if (after) {
+                move_segment_(t, i, len, t->pos[c], 0);
+            } else {
+                move_segment_(t, i, len, t->pos[f], 1);
+            }
+            push_active_(t, p);
+            push_active_(t, q);
+            push_active_(t, a);
+            push_active_(t, s2);
+            push_active_(t, c);
+            push_active_(t, after ? e : f);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int compare_keys_(const void *a, const void *b) {
+    uint64_t ka = *(const uint64_t *)a;
+    uint64_t kb = *(const uint64_t *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+/* Keeps the first visit of each point of a walk */
+static struct point *shortcut_walk_(const struct points_list *walk, size_t *points_num) {
+    size_t walk_num = get_points_num(walk);
+    uint64_t *keys = malloc(walk_num * sizeof(uint64_t) + 1);
+    _Bool *keep = calloc(walk_num + 1, sizeof(_Bool));
+    struct point *pts = malloc(walk_num * sizeof(struct point) + 1);
+    if ((keys == NULL) || (keep == NULL) || (pts == NULL)) {
+        free(keys);
+        free(keep);
+        free(pts);
+        return NULL;
+    }
+    for (size_t i = 0; i < walk_num; ++i) {
+        struct point pt;
+        (void)get_point_from_points_list(walk, i, &pt);
+        keys[i] = ((uint64_t)pt.y << 48) | ((uint64_t)pt.x << 32) | i;
+    }
+    qsort(keys, walk_num, sizeof(uint64_t), compare_keys_);
+    for (size_t i = 0; i < walk_num; ++i) {
+        if ((i == 0) || ((keys[i] >> 32) != (keys[i - 1] >> 32))) {
+            keep[keys[i] & UINT32_MAX] = 1;
+        }
+    }
+    *points_num = 0;
+    for (size_t i = 0; i < walk_num; ++i) {
+        if (keep[i]) {
+            (void)get_point_from_points_list(walk, i, &pts[(*points_num)++]);
+        }
+    }
+    free(keys);
+    free(keep);
+    return pts;
+}
+
+static double elapsed_(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + 1e-9 * (double)(now.tv_nsec - start->tv_nsec);
+}
+
+static int local_search_(struct tour *t, size_t neighbours, double seconds) {
+    size_t n = t->points_num;
+    uint32_t *near = malloc(n * neighbours * sizeof(uint32_t));
+    uint32_t *dist = malloc(n * neighbours * sizeof(uint32_t));
+    struct grid g = { 0 };
+    if ((near == NULL) || (dist == NULL) || (build_grid_(&g, t->pts, n) != 0)) {
+        free(near);
+        free(dist);
+        return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        struct search se = {
+            .pts = t->pts,
+            .comp = NULL,
+            .from = i,
+            .wanted = neighbours,
+            .found = 0,
+            .idx = near + i * neighbours,
+            .sqd = dist + i * neighbours,
+        };
+        search_grid_(&g, &se, UINT64_MAX);
+    }
+    destroy_grid_(&g);
+    free(dist);
+    for (size_t i = 0; i < n; ++i) {
+        push_active_(t, t->order[i]);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t pops = 0;
+    uint32_t a;
+    while (pop_active_(t, &a) == 0) {
+        if ((++pops % TOUR_CLOCK_PERIOD == 0) && (elapsed_(&start) > seconds)) {
+            break;
+        }
+        const uint32_t *na = near + (size_t)a * neighbours;
+        if (!two_opt_(t, a, na, neighbours)) {
+            (void)or_opt_(t, a, na, neighbours);
+        }
+    }
+    free(near);
+    return 0;
+}
+
+struct points_list *improve_cycle(const struct points_list *l, size_t neighbours, double seconds) {
+    size_t points_num = 0;
+    struct point *pts = shortcut_walk_(l, &points_num);
+    if (pts == NULL) {
+        return NULL;
+    }
+    struct tour t = {
+        .points_num = points_num,
+        .pts = pts,
+        .order = malloc(points_num * sizeof(uint32_t) + 1),
+        .pos = malloc(points_num * sizeof(uint32_t) + 1),
+        .queue = malloc(points_num * sizeof(uint32_t) + 1),
+        .queued = calloc(points_num + 1, sizeof(_Bool)),
+        .head = 0,
+        .queued_num = 0,
+    };
+    struct points_list *res = NULL;
+    if ((t.order != NULL) && (t.pos != NULL) && (t.queue != NULL) && (t.queued != NULL)) {
+        for (size_t i = 0; i < points_num; ++i) {
+            place_(&t, i, i);
+        }
+        if (neighbours > points_num - 1) {
+            neighbours = points_num - 1;
+        }
+        int r = 0;
+        if ((points_num >= 5) && (neighbours > 0) && (seconds > 0.0)) {
+            r = local_search_(&t, neighbours, seconds);
+        }
+        res = (r == 0) ? create_points_list(points_num) : NULL;
+    }
+    if (res != NULL) {
+        for (size_t i = 0; i < points_num; ++i) {
+            (void)set_point_from_points_list(res, i, &pts[t.order[i]]);
+        }
+    }
+    free(t.order);
+    free(t.pos);
+    free(t.queue);
+    free(t.queued);
+    free(pts);
+    return res;
+}
@@ -5,4 +5,13 @@
 
 struct points_list *short_cycle(const struct points_list *l);
 
+/* Like short_cycle, but the tree only uses edges to the nearest neighbours of each point (O(n.k) memory) */
+struct points_list *sparse_short_cycle(const struct points_list *l, size_t neighbours);
+
+/* Like short_cycle, the tree being built by Borůvka rounds spread over threads, in O(n) memory */
+struct points_list *parallel_short_cycle(const struct points_list *l, size_t threads);
+
+/* Drops the points visited again by a cycle, then shortens it by 2-opt and Or-opt moves towards the nearest neighbours for at most seconds */
+struct points_list *improve_cycle(const struct points_list *l, size_t neighbours, double seconds);
+
 #endif
@@ -0,0 +1,164 @@
+#include "strokecycle.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Side neighbours first, so that strokes are followed before diagonals cut corners */
+static const int8_t dirs_[8][2] = {
+    { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+    { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 },
+};
+
+struct canvas {
+    uint16_t min_x;
+    uint16_t min_y;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *todo;
+    size_t todo_num;
+};
+
+struct frame {
+    uint16_t x;
+    uint16_t y;
+    uint8_t dir;
+};
+
+static uint8_t *cell_(const struct canvas *c, int64_t x, int64_t y) {
+    if ((x < c->min_x) || (y < c->min_y)) {
+        return NULL;
+    }
+    x -= c->min_x;
+    y -= c->min_y;
+    if ((x >= c->width) || (y >= c->height)) {
+        return NULL;
+    }
+    return &c->todo[(size_t)y * c->width + x];
+}
+
+static int build_canvas_(struct canvas *c, const struct points_list *l) {
+    size_t points_num = get_points_num(l);
+    uint16_t max_x = 0;
+    uint16_t max_y = 0;
+    c->min_x = UINT16_MAX;
+    c->min_y = UINT16_MAX;
+    for (size_t i = 0; i < points_num; ++i) {
+        struct point pt;
+        (void)get_point_from_points_list(l, i, &pt);
+        c->min_x = (pt.x < c->min_x) ? pt.x : c->min_x;
+        c->min_y = (pt.y < c->min_y) ? pt.y : c->min_y;
+        max_x = (pt.x > max_x) ? pt.x : max_x;
+        max_y = (pt.y > max_y) ? pt.y : max_y;
+    }
+    if ((max_x < c->min_x) || (max_y < c->min_y)) {
+        return -1;
+    }
+    c->width = (uint32_t)(max_x - c->min_x) + 1;
+    c->height = (uint32_t)(max_y - c->min_y) + 1;
+    c->todo = calloc((size_t)c->width * c->height, 1);
+    if (c->todo == NULL) {
+        return -1;
+    }
+    c->todo_num = 0;
+    for (size_t i = 0; i < points_num; ++i) {
+        struct point pt;
+        (void)get_point_from_points_list(l, i, &pt);
+        uint8_t *t = cell_(c, pt.x, pt.y);
+        c->todo_num += (*t == 0);
+        *t = 1;
+    }
+    return 0;
+}
+
+/* Scans square rings around pt until no farther ring can hold a pixel closer than the best one found */
+static void nearest_todo_(const struct canvas *c, struct point *pt) {
+    uint64_t best = UINT64_MAX;
+    struct point found = *pt;
+    uint32_t last_ring = (c->width > c->height) ? c->width : c->height;
+    for (int64_t r = 1; r <= last_ring; ++r) {
+        if ((uint64_t)(r - 1) * (uint64_t)(r - 1) >= best) {
+            break;
+        }
+        for (int64_t dy = -r; dy <= r; ++dy) {
+            int64_t step = ((dy == -r) || (dy == r)) ? 1 : 2 * r;
+            for (int64_t dx = -r; dx <= r; dx += step) {
+                const uint8_t *t = cell_(c, (int64_t)pt->x + dx, (int64_t)pt->y + dy);
+                uint64_t d = (uint64_t)(dx * dx + dy * dy);
+                if ((t != NULL) && *t && (d < best)) {
+                    best = d;
+                    found.x = pt->x + dx;
+                    found.y = pt->y + dy;
+                }
+            }
+        }
+    }
+    *pt = found;
+    return;
+}
+
+struct points_list *stroke_cycle(const struct points_list *l) {
+    size_t points_num = get_points_num(l);
+    if (points_num < 1) {
+        return NULL;
+    }
+    struct canvas c = { 0 };
+    if (build_canvas_(&c, l) != 0) {
+        return NULL;
+    }
+    struct point *walk = malloc(2 * c.todo_num * sizeof(struct point));
+    struct frame *stack = malloc(c.todo_num * sizeof(struct frame));
+    if ((walk == NULL) || (stack == NULL)) {
+        free(c.todo);
+        free(walk);
+        free(stack);
+        return NULL;
+    }
+    size_t walk_num = 0;
+    struct point pt;
+    (void)get_point_from_points_list(l, 0, &pt);
+    while (c.todo_num > 0) {
+        if (!*cell_(&c, pt.x, pt.y)) {
+            nearest_todo_(&c, &pt);
+        }
+        /* Depth first walk of the stroke, the final way back to its first pixel being dropped */
+        size_t depth = 0;
+        *cell_(&c, pt.x, pt.y) = 0;
+        --c.todo_num;
+        walk[walk_num++] = pt;
+        stack[depth++] = (struct frame){ .x = pt.x, .y = pt.y, .dir = 0 };
+        size_t kept = walk_num;
+        while (depth > 0) {
+            struct frame *f = &stack[depth - 1];
+            if (f->dir == 8) {
+                --depth;
+                if (depth > 0) {
+                    walk[walk_num++] = (struct point){ .x = stack[depth - 1].x, .y = stack[depth - 1].y };
+                }
+                continue;
+            }
+            int64_t x = (int64_t)f->x + dirs_[f->dir][0];
+            int64_t y = (int64_t)f->y + dirs_[f->dir][1];
+            ++f->dir;
+            uint8_t *t = cell_(&c, x, y);
+            if ((t == NULL) || !*t) {
+                continue;
+            }
+            *t = 0;
+            --c.todo_num;
+            walk[walk_num++] = (struct point){ .x = x, .y = y };
+            stack[depth++] = (struct frame){ .x = x, .y = y, .dir = 0 };
+            kept = walk_num;
+        }
+        walk_num = kept;
+        pt = walk[walk_num - 1];
+    }
+    struct points_list *res = create_points_list(walk_num);
+    if (res != NULL) {
+        for (size_t i = 0; i < walk_num; ++i) {
+            (void)set_point_from_points_list(res, i, &walk[i]);
+        }
+    }
+    free(c.todo);
+    free(walk);
+    free(stack);
+    return res;
+}
@@ -0,0 +1,14 @@
+#ifndef STROKE_CYCLE_H_
+#define STROKE_CYCLE_H_
+
+#include "../types/pointslist.h"
+
+/*
+ * Same contract as short_cycle, built by walking the 8-connected strokes
+ * (backtracking at junctions and endpoints), each stroke being left from its
+ * last pixel towards the nearest pixel not yet visited. Linear in the number
+ * of points for 1 pixel wide drawings.
+ */
+struct points_list *stroke_cycle(const struct points_list *l);
+
+#endif
@@ -5,11 +5,97 @@
 
 #include "bitmap.h"
 
+struct row_kernels {
+    uint16_t bits_per_pixel;
+    void (*unpack)(const uint8_t *line, uint32_t x, uint32_t count, uint32_t *color_indexes);
+    void (*pack)(uint8_t *line, uint32_t x, uint32_t count, const uint32_t *color_indexes);
+};
+
+/* Depths below 8 bits, the first pixel of each byte being in its most significant bits */
+#define PACKED_ROW_KERNELS(bpp) \
+static void unpack_##bpp##_(const uint8_t *line, uint32_t x, uint32_t count, uint32_t *color_indexes) { \
+    for (uint32_t i = 0; i < count; ++i) { \
+        uint32_t p = x + i; \
+        unsigned int shift = 8 - (bpp) - (p % (8 / (bpp))) * (bpp); \
+        color_indexes[i] = (line[p / (8 / (bpp))] >> shift) & ((1u << (bpp)) - 1); \
+    } \
+    return; \
+} \
+static void pack_##bpp##_(uint8_t *line, uint32_t x, uint32_t count, const uint32_t *color_indexes) { \
+    for (uint32_t i = 0; i < count; ++i) { \
+        uint32_t p = x + i; \
+        unsigned int shift = 8 - (bpp) - (p % (8 / (bpp))) * (bpp); \
+        uint8_t mask = ((1u << (bpp)) - 1) << shift; \
+        uint8_t *byte = &line[p / (8 / (bpp))]; \
+        *byte = (*byte & ~mask) | ((color_indexes[i] << shift) & mask); \
+    } \
+    return; \
+}
+
+/* Depths of whole machine words, loaded through memcpy since a mapped file does not align its rows */
+#define CELL_ROW_KERNELS(bpp, type) \
+static void unpack_##bpp##_(const uint8_t *line, uint32_t x, uint32_t count, uint32_t *color_indexes) { \
+    const uint8_t *cells = line + (size_t)x * sizeof(type); \
+    for (uint32_t i = 0; i < count; ++i) { \
+        type cell; \
+        memcpy(&cell, cells + i * sizeof(type), sizeof(type)); \
+        color_indexes[i] = cell; \
+    } \
+    return; \
+} \
+static void pack_##bpp##_(uint8_t *line, uint32_t x, uint32_t count, const uint32_t *color_indexes) { \
+    uint8_t *cells = line + (size_t)x * sizeof(type); \
+    for (uint32_t i = 0; i < count; ++i) { \
+        type cell = color_indexes[i]; \
+        memcpy(cells + i * sizeof(type), &cell, sizeof(type)); \
+    } \
+    return; \
+}
+
+PACKED_ROW_KERNELS(1)
+PACKED_ROW_KERNELS(4)
+CELL_ROW_KERNELS(8, uint8_t)
+CELL_ROW_KERNELS(16, uint16_t)
+CELL_ROW_KERNELS(32, uint32_t)
+
+/* 3 bytes per pixel, least significant first */
+static void unpack_24_(const uint8_t *line, uint32_t x, uint32_t count, uint32_t *color_indexes) {
+    const uint8_t *bytes = line + 3 * (size_t)x;
+    for (uint32_t i = 0; i < count; ++i) {
+        color_indexes[i] = bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16);
+        bytes += 3;
+    }
+    return;
+}
+
+static void pack_24_(uint8_t *line, uint32_t x, uint32_t count, const uint32_t *color_indexes) {
+    uint8_t *bytes = line + 3 * (size_t)x;
+    for (uint32_t i = 0; i < count; ++i) {
+        bytes[0] = color_indexes[i];
+        bytes[1] = color_indexes[i] >> 8;
+        bytes[2] = color_indexes[i] >> 16;
+        bytes += 3;
+    }
+    return;
+}
+
+static const struct row_kernels row_kernels_[] = {
+    { 1, unpack_1_, pack_1_ },
+    { 4, unpack_4_, pack_4_ },
+    { 8, unpack_8_, pack_8_ },
+    { 16, unpack_16_, pack_16_ },
+    { 24, unpack_24_, pack_24_ },
+    { 32, unpack_32_, pack_32_ },
+};
+
 struct raw_bitmap {
     struct raw_bitmap_info rbi;
+    const struct row_kernels *kernels;
     struct rgba *color_map;
-    uint32_t *bitmap_array;
-    size_t line_words;
+    uint8_t *bitmap_array;
+    size_t line_bytes;
+    void (*release)(void *context);
+    void *context;
     uint32_t data[];
 };
 
@@ -34,44 +120,8 @@ int get_pixel(const struct raw_bitmap *bm, uint32_t x, uint32_t y, uint32_t *col
     if (x >= bm->rbi.width) {
         return -1;
     }
-    uint32_t *line = bm->bitmap_array + y * bm->line_words;
-    if (bm->rbi.bits_per_pixel <= 8) {
-        uint8_t *subline = (uint8_t*)line;
-        size_t k = 8 / bm->rbi.bits_per_pixel;
-        size_t counter_shift = 8 - bm->rbi.bits_per_pixel;
-        size_t shift = (x%k) * bm->rbi.bits_per_pixel;
-        uint8_t ci = subline[x / k] << shift;
-        ci >>= counter_shift;
-        *color_index = ci;
-        return 0;
-    }
-    if (bm->rbi.bits_per_pixel == 32) {
-        *color_index = line[x];
-        return 0;
-    }
-    if (bm->rbi.bits_per_pixel == 16) {
-        uint16_t *subline = (uint16_t *)line;
-        *color_index = subline[x];
-        return 0;
-    }
-    if (bm->rbi.bits_per_pixel == 24) {
-        size_t shift = (x >> 2) * 3;
-        switch (x % 4) {
-            case 0:
-                *color_index = line[shift] & UINT32_C(0xffffff);
-                return 0;
-            case 1:
-                *color_index = (line[shift] << 24) | ((line[shift + 1] & UINT32_C(0xffff)) >> 8);
-                return 0;
-            case 2:
-                *color_index = (line[shift + 1] << 16) | ((line[shift + 2] & UINT32_C(0xff)) >> 16);
-                return 0;
-            case 3:
-                *color_index = line[shift + 2] << 8;
-                return 0;
-        }
-    }
-    return -1;
+    bm->kernels->unpack(bm->bitmap_array + y * bm->line_bytes, x, 1, color_index);
+    return 0;
 }
 
 int set_pixel(struct raw_bitmap *bm, uint32_t x, uint32_t y, uint32_t color_index) {
@@ -84,58 +134,66 @@ int set_pixel(struct raw_bitmap *bm, uint32_t x, uint32_t y, uint32_t color_inde
     if (x >= bm->rbi.width) {
         return -1;
     }
-    uint32_t *line = bm->bitmap_array + y * bm->line_words;
-    if (bm->rbi.bits_per_pixel <= 8) {
-        uint8_t *subline = (uint8_t*)line;
-        size_t k = 8 / bm->rbi.bits_per_pixel;
-        size_t offset = x / k;
-        size_t counter_shift = 8 - bm->rbi.bits_per_pixel;
-        size_t shift = (x%k) * bm->rbi.bits_per_pixel;
-        uint8_t mask = UINT8_MAX;
-        uint8_t ci = color_index;
-        ci <<= counter_shift;
-        mask <<= counter_shift;
-        ci >>= shift;
-        mask >>= shift;
-        subline[offset] &= ~mask;
-        subline[offset] |= ci;
-        return 0;
+    bm->kernels->pack(bm->bitmap_array + y * bm->line_bytes, x, 1, &color_index);
+    return 0;
+}
+
+const uint8_t *get_row_bytes(const struct raw_bitmap *bm, uint32_t y) {
+    if (bm == NULL) {
+        return NULL;
     }
-    if (bm->rbi.bits_per_pixel == 32) {
-        line[x] = color_index;
-        return 0;
+    if (y >= bm->rbi.height) {
+        return NULL;
     }
-    if (bm->rbi.bits_per_pixel == 16) {
-        uint16_t *subline = (uint16_t *)line;
-        subline[x] = color_index;
+    return bm->bitmap_array + y * bm->line_bytes;
+}
+
+uint8_t *get_mutable_row_bytes(struct raw_bitmap *bm, uint32_t y) {
+    if (bm == NULL) {
+        return NULL;
+    }
+    if (y >= bm->rbi.height) {
+        return NULL;
+    }
+    return bm->bitmap_array + y * bm->line_bytes;
+}
+
+size_t get_row_bytes_num(const struct raw_bitmap *bm) {
+    if (bm == NULL) {
         return 0;
     }
-    if (bm->rbi.bits_per_pixel == 24) {
-        size_t shift = (x >> 2) * 3;
-        switch (x % 4) {
-            case 0:
-                line[shift] &= UINT32_C(0xff000000);
-                line[shift] |= (color_index & UINT32_C(0x00ffffff));
-                return 0;
-            case 1:
-                line[shift] &= UINT32_C(0x00ffffff);
-                line[shift] |= color_index << 24;
-                line[shift + 1] &= UINT32_C(0xffff0000);
-                line[shift + 1] |= (color_index >> 8) & UINT32_C(0x0000ffff);
-                return 0;
-            case 2:
-                line[shift + 1] &= UINT32_C(0x0000ffff);
-                line[shift + 1] |= color_index << 16;
-                line[shift + 2] &= UINT32_C(0xffffff00);
-                line[shift + 2] |= (color_index >> 16) & UINT32_C(0x000000ff);
-                return 0;
-            case 3:
-                line[shift + 2] &= UINT32_C(0x000000ff);
-                line[shift + 2] |= color_index << 8;
-                return 0;
-        }
+    return bm->line_bytes;
+}
+static int check_span_(const struct raw_bitmap *bm, uint32_t y, uint32_t x, uint32_t count, const uint32_t *color_indexes) {
+    if (bm == NULL) {
+        return -1;
+    }
+    if ((color_indexes == NULL) && (count > 0)) {
+        return -1;
+    }
+    if (y >= bm->rbi.height) {
+        return -1;
     }
-    return -1;
+    if ((x > bm->rbi.width) || (count > bm->rbi.width - x)) {
+        return -1;
+    }
+    return 0;
+}
+
+int get_row(const struct raw_bitmap *bm, uint32_t y, uint32_t x, uint32_t count, uint32_t *color_indexes) {
+    if (check_span_(bm, y, x, count, color_indexes) != 0) {
+        return -1;
+    }
+    bm->kernels->unpack(bm->bitmap_array + y * bm->line_bytes, x, count, color_indexes);
+    return 0;
+}
+
+int set_row(struct raw_bitmap *bm, uint32_t y, uint32_t x, uint32_t count, const uint32_t *color_indexes) {
+    if (check_span_(bm, y, x, count, color_indexes) != 0) {
+        return -1;
+    }
+    bm->kernels->pack(bm->bitmap_array + y * bm->line_bytes, x, count, color_indexes);
+    return 0;
 }
 
 int get_color(const struct raw_bitmap *bm, uint32_t index, struct rgba *color) {
@@ -163,20 +221,18 @@ int set_color(struct raw_bitmap *bm, uint32_t index, struct rgba color) {
     return 0;
 }
 
-struct raw_bitmap *create_raw_bitmap(struct raw_bitmap_info rbi) {
-    switch (rbi.bits_per_pixel) {
-        case 1:
-        case 4:
-        case 8:
-        case 16:
-        case 24:
-        case 32:
-            break;
-        default:
-            return NULL;
+static struct raw_bitmap *alloc_raw_bitmap_(struct raw_bitmap_info rbi, _Bool with_bitmap) {
+    const struct row_kernels *kernels = NULL;
+    for (size_t k = 0; k < sizeof(row_kernels_) / sizeof(row_kernels_[0]); ++k) {
+        if (row_kernels_[k].bits_per_pixel == rbi.bits_per_pixel) {
+            kernels = &row_kernels_[k];
+        }
+    }
+    if (kernels == NULL) {
+        return NULL;
     }
     uint32_t line_words = ((rbi.width * rbi.bits_per_pixel + 31) >> 5);
-    uint32_t bitmap_size = line_words * rbi.height * sizeof(uint32_t);
+    uint32_t bitmap_size = with_bitmap ? line_words * rbi.height * sizeof(uint32_t) : 0;
     uint32_t color_map_size = 0;
     if (rbi.bits_per_pixel <= 8) {
         if (rbi.colors_in_color_map == 0) {
@@ -196,14 +252,41 @@ struct raw_bitmap *create_raw_bitmap(struct raw_bitmap_info rbi) {
         return NULL;
     }
     bm->rbi = rbi;
+    bm->kernels = kernels;
     bm->color_map = (struct rgba *)bm->data;
-    bm->bitmap_array = bm->data + rbi.colors_in_color_map;
-    bm->line_words = line_words;
+    bm->bitmap_array = (uint8_t *)(bm->data + rbi.colors_in_color_map);
+    bm->line_bytes = line_words * sizeof(uint32_t);
+    bm->release = NULL;
+    bm->context = NULL;
     memset(bm->data, 0, color_map_size + bitmap_size);
     return bm;
 }
 
+struct raw_bitmap *create_raw_bitmap(struct raw_bitmap_info rbi) {
+    return alloc_raw_bitmap_(rbi, 1);
+}
+
+struct raw_bitmap *wrap_raw_bitmap(struct raw_bitmap_info rbi, uint8_t *bitmap_array, void (*release)(void *context), void *context) {
+    if (bitmap_array == NULL) {
+        return NULL;
+    }
+    struct raw_bitmap *bm = alloc_raw_bitmap_(rbi, 0);
+    if (bm == NULL) {
+        return NULL;
+    }
+    bm->bitmap_array = bitmap_array;
+    bm->release = release;
+    bm->context = context;
+    return bm;
+}
+
 void destroy_raw_bitmap(struct raw_bitmap *bm) {
+    if (bm == NULL) {
+        return;
+    }
+    if (bm->release != NULL) {
+        bm->release(bm->context);
+    }
     memset(bm, 0, sizeof(*bm));
     free(bm);
     return;
@@ -241,7 +324,7 @@ int set_bitmap(struct raw_bitmap *bm, const uint8_t *bitmap, size_t bitmap_size)
     if (bm == NULL) {
         return -1;
     }
-    if ((bm->line_words * bm->rbi.height * sizeof(uint32_t)) != bitmap_size) {
+    if ((bm->line_bytes * bm->rbi.height) != bitmap_size) {
         return -1;
     }
     if (bitmap_size == 0) {
@@ -258,7 +341,7 @@ int get_bitmap(const struct raw_bitmap *bm, uint8_t *bitmap, size_t bitmap_size)
     if (bm == NULL) {
         return -1;
     }
-    if ((bm->line_words * bm->rbi.height * sizeof(uint32_t)) != bitmap_size) {
+    if ((bm->line_bytes * bm->rbi.height) != bitmap_size) {
         return -1;
     }
     if (bitmap_size == 0) {
@@ -28,6 +28,19 @@ int get_pixel(const struct raw_bitmap *bm, uint32_t x, uint32_t y, uint32_t *col
 
 int set_pixel(struct raw_bitmap *bm, uint32_t x, uint32_t y, uint32_t color_index);
 
+/* Storage of row y, as laid out in the file (pixels packed from the most significant bits of each byte), NULL if out of bounds; it may not be aligned, words are read with memcpy */
+const uint8_t *get_row_bytes(const struct raw_bitmap *bm, uint32_t y);
+
+uint8_t *get_mutable_row_bytes(struct raw_bitmap *bm, uint32_t y);
+
+/* Number of bytes per row, a multiple of 4, rows following each other in storage */
+size_t get_row_bytes_num(const struct raw_bitmap *bm);
+
+/* Color indexes of the count pixels of row y starting at x, one kernel per depth instead of one dispatch per pixel */
+int get_row(const struct raw_bitmap *bm, uint32_t y, uint32_t x, uint32_t count, uint32_t *color_indexes);
+
+int set_row(struct raw_bitmap *bm, uint32_t y, uint32_t x, uint32_t count, const uint32_t *color_indexes);
+
 int get_color(const struct raw_bitmap *bm, uint32_t index, struct rgba *color);
 
 int set_color(struct raw_bitmap *bm, uint32_t index, struct rgba color);
@@ -42,6 +55,9 @@ int get_bitmap(const struct raw_bitmap *bm, uint8_t *bitmap, size_t bitmap_size)
 
 struct raw_bitmap *create_raw_bitmap(struct raw_bitmap_info rbi);
 
+/* Bitmap using the caller's pixel array (rows padded to 32 bits, at any address) instead of its own, release(context) is called when it is destroyed */
+struct raw_bitmap *wrap_raw_bitmap(struct raw_bitmap_info rbi, uint8_t *bitmap_array, void (*release)(void *context), void *context);
+
 void destroy_raw_bitmap(struct raw_bitmap *bm);
 
 #endif
@@ -5,7 +5,10 @@
 
 struct doubles_list {
     size_t doubles_num;
-    double doubles[];
+    double *doubles;
+    void (*release)(void *context);
+    void *context;
+    double storage[];
 };
 
 struct doubles_list *create_doubles_list(size_t doubles_num) {
@@ -13,8 +16,26 @@ struct doubles_list *create_doubles_list(size_t doubles_num) {
     if (res == NULL) {
         return NULL;
     }
-    memset(res->doubles, 0, sizeof(double) * doubles_num);
+    memset(res->storage, 0, sizeof(double) * doubles_num);
     res->doubles_num = doubles_num;
+    res->doubles = res->storage;
+    res->release = NULL;
+    res->context = NULL;
+    return res;
+}
+
+struct doubles_list *wrap_doubles_list(size_t doubles_num, double *doubles, void (*release)(void *context), void *context) {
+    if (doubles == NULL) {
+        return NULL;
+    }
+    struct doubles_list *res = malloc(sizeof(*res));
+    if (res == NULL) {
+        return NULL;
+    }
+    res->doubles_num = doubles_num;
+    res->doubles = doubles;
+    res->release = release;
+    res->context = context;
     return res;
 }
 
@@ -22,6 +43,9 @@ void destroy_doubles_list(struct doubles_list *dl) {
     if (dl == NULL) {
         return;
     }
+    if (dl->release != NULL) {
+        dl->release(dl->context);
+    }
     free(dl);
     return;
 }
@@ -52,3 +76,17 @@ void set_double_from_doubles_list(struct doubles_list *dl, size_t index, double
     }
     return;
 }
+
+const double *get_doubles_array(const struct doubles_list *dl) {
+    if (dl == NULL) {
+        return NULL;
+    }
+    return dl->doubles;
+}
+
+double *get_mutable_doubles_array(struct doubles_list *dl) {
+    if (dl == NULL) {
+        return NULL;
+    }
+    return dl->doubles;
+}
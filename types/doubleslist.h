@@ -8,6 +8,9 @@ struct doubles_list;
 
 struct doubles_list *create_doubles_list(size_t doubles_num);
 
+/* List using the caller's array instead of its own, release(context) is called when it is destroyed */
+struct doubles_list *wrap_doubles_list(size_t doubles_num, double *doubles, void (*release)(void *context), void *context);
+
 void destroy_doubles_list(struct doubles_list *dl);
 
 size_t get_doubles_num(const struct doubles_list *dl);
@@ -16,4 +19,8 @@ double get_double_from_doubles_list(const struct doubles_list *dl, size_t index)
 
 void set_double_from_doubles_list(struct doubles_list *dl, size_t index, double d);
 
+const double *get_doubles_array(const struct doubles_list *dl);
+
+double *get_mutable_doubles_array(struct doubles_list *dl);
+
 #endif
@@ -2,6 +2,14 @@
 #include <stdint.h>
 #include "fbase.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FBASE_KERNEL __attribute__((target_clones("avx2", "sse4.1", "default")))
+#else
+#define FBASE_KERNEL
+#endif
+
+#define FBASE_BLOCK 256
+
 double fourier(size_t mode, double t) {
     if (mode == 0) {
         return 1.0;
@@ -10,6 +18,25 @@ double fourier(size_t mode, double t) {
     return cos((((double)((mode + 1) / 2)) * t * 2.0 + shift) * M_PI) * sqrt(2.0);
 }
 
+static void heaviside_split_(size_t mode, uint32_t *mode32, uint32_t *submode) {
+    uint32_t m = mode;
+    m |= m >> 16;
+    m |= m >> 8;
+    m |= m >> 4;
+    m |= m >> 2;
+    m |= m >> 1;
+    m += 1;
+    m >>= 1;
+    *mode32 = m;
+    *submode = mode;
+    *submode ^= m;
+    return;
+}
+
+static double heaviside_phase_(uint32_t mode32, uint32_t submode, double t) {
+    return (t * ((double)mode32) - submode) * 2.0 - 1.0;
+}
+
 double heaviside(size_t mode, double t) {
     if (mode == 0) {
         return 1.0;
@@ -17,17 +44,10 @@ double heaviside(size_t mode, double t) {
     if (mode > UINT32_MAX) {
         return 1.0;
     }
-    uint32_t mode32 = mode;
-    mode32 |= mode32 >> 16;
-    mode32 |= mode32 >> 8;
-    mode32 |= mode32 >> 4;
-    mode32 |= mode32 >> 2;
-    mode32 |= mode32 >> 1;
-    mode32 += 1;
-    mode32 >>= 1;
-    uint32_t submode = mode;
-    submode ^= mode32;
-    double u = (t * ((double)mode32) - submode) * 2.0 - 1.0;
+    uint32_t mode32;
+    uint32_t submode;
+    heaviside_split_(mode, &mode32, &submode);
+    double u = heaviside_phase_(mode32, submode, t);
     double k = sqrt((double)mode32);
     if (u < 0.0) {
         if (u < -1.0) {
@@ -44,6 +64,37 @@ double heaviside(size_t mode, double t) {
     }
 }
 
+static size_t heaviside_first_(uint32_t mode32, uint32_t submode, size_t points, double threshold) {
+    double dt = 1.0 / (double)points;
+    size_t low = 0;
+    size_t high = points;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (heaviside_phase_(mode32, submode, ((double)mid) * dt) < threshold) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+double heaviside_edges(size_t mode, size_t points, size_t edges[3]) {
+    if ((mode == 0) || (mode > UINT32_MAX)) {
+        edges[0] = 0;
+        edges[1] = 0;
+        edges[2] = points;
+        return 1.0;
+    }
+    uint32_t mode32;
+    uint32_t submode;
+    heaviside_split_(mode, &mode32, &submode);
+    edges[0] = heaviside_first_(mode32, submode, points, -1.0);
+    edges[1] = heaviside_first_(mode32, submode, points, 0.0);
+    edges[2] = heaviside_first_(mode32, submode, points, 1.0);
+    return sqrt((double)mode32);
+}
+
 double legendre(size_t mode, double t) {
     if (mode == 0) {
         return 1.0;
@@ -60,3 +111,182 @@ double legendre(size_t mode, double t) {
     }
     return b * sqrt((double)(2 * mode + 1));
 }
+
+void legendre_values(size_t modes, double t, double *values) {
+    if (modes == 0) {
+        return;
+    }
+    values[0] = 1.0;
+    if (modes == 1) {
+        return;
+    }
+    t = t * 2.0 - 1.0;
+    double a = 1.0;
+    double b = t;
+    size_t n = 1;
+    values[1] = b * sqrt(3.0);
+    while (n + 1 < modes) {
+        double h = ((double)(2 * n + 1)) * t * b - ((double)n) * a;
+        a = b;
+        ++n;
+        b = h / ((double)n);
+        values[n] = b * sqrt((double)(2 * n + 1));
+    }
+    return;
+}
+
+void base_values(double (*base)(size_t,double), size_t modes, double t, double *values) {
+    if (base == legendre) {
+        legendre_values(modes, t, values);
+        return;
+    }
+    for (size_t mode = 0; mode < modes; ++mode) {
+        values[mode] = base(mode, t);
+    }
+    return;
+}
+
+/* Nearest integer for |x| < 2^51, without a libm call so that loops still vectorise */
+static inline double round_(double x) {
+    return (x + 6755399441055744.0) - 6755399441055744.0;
+}
+
+/* cos(2πx), reduced to an angle in [-π/4, π/4] and expanded as Taylor series */
+static inline double cos_2pi_(double x) {
+    double q = round_(x * 4.0);
+    double a = (x * 4.0 - q) * (M_PI / 2.0);
+    double a2 = a * a;
+    double c = 1.0 + a2 * (-1.0 / 2.0 + a2 * (1.0 / 24.0 + a2 * (-1.0 / 720.0 + a2 * (1.0 / 40320.0
+        + a2 * (-1.0 / 3628800.0 + a2 * (1.0 / 479001600.0 + a2 * (-1.0 / 87178291200.0
+        + a2 * (1.0 / 20922789888000.0))))))));
+    double s = a * (1.0 + a2 * (-1.0 / 6.0 + a2 * (1.0 / 120.0 + a2 * (-1.0 / 5040.0 + a2 * (1.0 / 362880.0
+        + a2 * (-1.0 / 39916800.0 + a2 * (1.0 / 6227020800.0 + a2 * (-1.0 / 1307674368000.0
+        + a2 * (1.0 / 355687428096000.0)))))))));
+    /* Branchless quadrant selection: c, -s, -c, s */
+    double half = round_(q * 0.5 - 0.25);
+    double odd = q - 2.0 * half;
+    double half_odd = half - 2.0 * round_(half * 0.5 - 0.25);
+    double negative = half_odd + odd - 2.0 * half_odd * odd;
+    return (1.0 - 2.0 * negative) * (odd * s + (1.0 - odd) * c);
+}
+
+FBASE_KERNEL
+static void fourier_block_(const double *phases, size_t count, double *values) {
+    for (size_t j = 0; j < count; ++j) {
+        values[j] = cos_2pi_(phases[j]) * sqrt(2.0);
+    }
+    return;
+}
+
+static void fourier_grid_(size_t mode, size_t points, size_t first, size_t count, double *values) {
+    uint64_t freq = ((mode + 1) / 2) % points;
+    uint64_t phase = (freq * (first % points)) % points;
+    double shift = ((mode % 2) == 0) ? 0.25 : 0.0;
+    double phases[FBASE_BLOCK];
+    while (count > 0) {
+        size_t block = (count < FBASE_BLOCK) ? count : FBASE_BLOCK;
+        for (size_t j = 0; j < block; ++j) {
+            phases[j] = ((double)phase) / ((double)points) + shift;
+            phase += freq;
+            if (phase >= points) {
+                phase -= points;
+            }
+        }
+        fourier_block_(phases, block, values);
+        values += block;
+        count -= block;
+    }
+    return;
+}
+
+FBASE_KERNEL
+static void fill_(double *values, size_t count, double v) {
+    for (size_t j = 0; j < count; ++j) {
+        values[j] = v;
+    }
+    return;
+}
+
+static void heaviside_grid_(size_t mode, size_t points, size_t first, size_t count, double *values) {
+    size_t edges[3];
+    double k = heaviside_edges(mode, points, edges);
+    size_t i = first;
+    size_t last = first + count;
+    double levels[4] = { 0.0, -k, k, 0.0 };
+    for (size_t part = 0; part < 4; ++part) {
+        size_t end = (part < 3) ? edges[part] : last;
+        if (end > last) {
+            end = last;
+        }
+        if (end > i) {
+            fill_(values + (i - first), end - i, levels[part]);
+            i = end;
+        }
+    }
+    return;
+}
+
+FBASE_KERNEL
+static void legendre_block_(size_t mode, size_t points, size_t first, size_t count, double *values) {
+    double t[FBASE_BLOCK];
+    double a[FBASE_BLOCK];
+    double dt = 1.0 / (double)points;
+    for (size_t j = 0; j < count; ++j) {
+        t[j] = ((double)(first + j)) * dt * 2.0 - 1.0;
+        a[j] = 1.0;
+        values[j] = t[j];
+    }
+    for (size_t n = 1; n < mode; ++n) {
+        double kb = (double)(2 * n + 1);
+        double ka = (double)n;
+        double kh = (double)(n + 1);
+        for (size_t j = 0; j < count; ++j) {
+            double h = kb * t[j] * values[j] - ka * a[j];
+            a[j] = values[j];
+            values[j] = h / kh;
+        }
+    }
+    double k = sqrt((double)(2 * mode + 1));
+    for (size_t j = 0; j < count; ++j) {
+        values[j] *= k;
+    }
+    return;
+}
+
+static void legendre_grid_(size_t mode, size_t points, size_t first, size_t count, double *values) {
+    while (count > 0) {
+        size_t block = (count < FBASE_BLOCK) ? count : FBASE_BLOCK;
+        legendre_block_(mode, points, first, block, values);
+        first += block;
+        values += block;
+        count -= block;
+    }
+    return;
+}
+
+void base_grid(double (*base)(size_t,double), size_t mode, size_t points, size_t first, size_t count, double *values) {
+    if ((points == 0) || (count == 0)) {
+        return;
+    }
+    if (((base == fourier) || (base == legendre)) && (mode == 0)) {
+        fill_(values, count, 1.0);
+        return;
+    }
+    if (base == fourier) {
+        fourier_grid_(mode, points, first, count, values);
+        return;
+    }
+    if (base == heaviside) {
+        heaviside_grid_(mode, points, first, count, values);
+        return;
+    }
+    if (base == legendre) {
+        legendre_grid_(mode, points, first, count, values);
+        return;
+    }
+    double dt = 1.0 / (double)points;
+    for (size_t j = 0; j < count; ++j) {
+        values[j] = base(mode, ((double)(first + j)) * dt);
+    }
+    return;
+}
@@ -7,6 +7,17 @@ double fourier(size_t mode, double t);
 
 double heaviside(size_t mode, double t);
 
+/* On the grid t = i / points, heaviside(mode, t) is -k for i in [edges[0], edges[1]), k for i in [edges[1], edges[2]) and 0 elsewhere, returns k */
+double heaviside_edges(size_t mode, size_t points, size_t edges[3]);
+
 double legendre(size_t mode, double t);
 
+/* values[mode] = legendre(mode, t) for mode < modes, in one pass of the recurrence */
+void legendre_values(size_t modes, double t, double *values);
+
+void base_values(double (*base)(size_t,double), size_t modes, double t, double *values);
+
+/* values[j] = base(mode, (first + j) / points) for j < count */
+void base_grid(double (*base)(size_t,double), size_t mode, size_t points, size_t first, size_t count, double *values);
+
 #endif
@@ -0,0 +1,311 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fft.h"
+
+#define FFT_MAX_FACTORS 64
+#define FFT_MAX_RADIX 32
+
+struct fft_plan {
+    size_t points;
+    size_t factors_num;
+    size_t factors[FFT_MAX_FACTORS];
+    struct fft_plan *chirp_plan;
+    double complex *chirp;
+    double complex *chirp_spectrum;
+    double complex twiddles[];
+};
+
+struct real_fft_plan {
+    size_t points;
+    struct fft_plan *plan;
+    double complex twiddles[];
+};
+
+static inline double complex cmul_(double complex a, double complex b) {
+    return CMPLX(creal(a) * creal(b) - cimag(a) * cimag(b), creal(a) * cimag(b) + cimag(a) * creal(b));
+}
+
+static inline double complex twiddle_(const struct fft_plan *plan, size_t index, int backward) {
+    return backward ? conj(plan->twiddles[index]) : plan->twiddles[index];
+}
+
+static int factorize_(size_t points, size_t *factors, size_t *factors_num) {
+    *factors_num = 0;
+    size_t p = 2;
+    while (points > 1) {
+        if (p > FFT_MAX_RADIX) {
+            return -1;
+        }
+        if ((points % p) == 0) {
+            factors[*factors_num] = p;
+            ++*factors_num;
+            points /= p;
+        } else {
+            ++p;
+        }
+    }
+    return 0;
+}
+
+static void transform_(const struct fft_plan *plan, double complex *out, const double complex *in, size_t points, size_t stride, const size_t *factors, int backward) {
+    size_t p = factors[0];
+    size_t m = points / p;
+    size_t tw_stride = plan->points / points;
+    if (m == 1) {
+        for (size_t q = 0; q < p; ++q) {
+            out[q] = in[q * stride];
+        }
+    } else {
+        for (size_t q = 0; q < p; ++q) {
+            transform_(plan, out + q * m, in + q * stride, m, stride * p, factors + 1, backward);
+        }
+    }
+    if (p == 2) {
+        for (size_t k = 0; k < m; ++k) {
+            double complex a = out[k];
+            double complex b = cmul_(out[k + m], twiddle_(plan, k * tw_stride, backward));
+            out[k] = a + b;
+            out[k + m] = a - b;
+        }
+        return;
+    }
+    double complex tmp[FFT_MAX_RADIX];
+    size_t root_stride = plan->points / p;
+    for (size_t k = 0; k < m; ++k) {
+        for (size_t q = 0; q < p; ++q) {
+            tmp[q] = cmul_(out[q * m + k], twiddle_(plan, q * k * tw_stride, backward));
+        }
+        for (size_t s = 0; s < p; ++s) {
+            double complex acc = tmp[0];
+            size_t qs = 0;
+            for (size_t q = 1; q < p; ++q) {
+                qs += s;
+                if (qs >= p) {
+                    qs -= p;
+                }
+                acc += cmul_(tmp[q], twiddle_(plan, qs * root_stride, backward));
+            }
+            out[s * m + k] = acc;
+        }
+    }
+    return;
+}
+
+static int bluestein_(const struct fft_plan *plan, const double complex *in, double complex *out, int backward) {
+    size_t chirp_points = plan->chirp_plan->points;
+    double complex *work = malloc(2 * chirp_points * sizeof(*work));
+    if (work == NULL) {
+        return -1;
+    }
+    double complex *a = work;
+    double complex *spectrum = work + chirp_points;
+    for (size_t n = 0; n < plan->points; ++n) {
+        double complex x = backward ? conj(in[n]) : in[n];
+        a[n] = cmul_(x, plan->chirp[n]);
+    }
+    memset(a + plan->points, 0, (chirp_points - plan->points) * sizeof(*a));
+    (void)fft_forward(plan->chirp_plan, a, spectrum);
+    for (size_t j = 0; j < chirp_points; ++j) {
+        spectrum[j] = cmul_(spectrum[j], plan->chirp_spectrum[j]);
+    }
+    (void)fft_backward(plan->chirp_plan, spectrum, a);
+    double scale = 1.0 / (double)chirp_points;
+    for (size_t k = 0; k < plan->points; ++k) {
+        double complex y = cmul_(a[k], plan->chirp[k]) * scale;
+        out[k] = backward ? conj(y) : y;
+    }
+    free(work);
+    return 0;
+}
+
+static int create_chirp_(struct fft_plan *plan) {
+    size_t points = plan->points;
+    size_t chirp_points = 1;
+    while (chirp_points < 2 * points - 1) {
+        chirp_points <<= 1;
+    }
+    plan->chirp_plan = create_fft_plan(chirp_points);
+    plan->chirp = malloc(points * sizeof(double complex));
+    plan->chirp_spectrum = malloc(chirp_points * sizeof(double complex));
+    double complex *filter = calloc(chirp_points, sizeof(double complex));
+    if ((plan->chirp_plan == NULL) || (plan->chirp == NULL) || (plan->chirp_spectrum == NULL) || (filter == NULL)) {
+        free(filter);
+        return -1;
+    }
+    /* chirp[k] = exp(-iπk²/points), k² being reduced modulo 2 * points */
+    size_t square = 0;
+    for (size_t k = 0; k < points; ++k) {
+        double angle = M_PI * (double)square / (double)points;
+        plan->chirp[k] = CMPLX(cos(angle), -sin(angle));
+        square += 2 * k + 1;
+        square %= 2 * points;
+    }
+    filter[0] = conj(plan->chirp[0]);
+    for (size_t k = 1; k < points; ++k) {
+        filter[k] = conj(plan->chirp[k]);
+        filter[chirp_points - k] = conj(plan->chirp[k]);
+    }
+    (void)fft_forward(plan->chirp_plan, filter, plan->chirp_spectrum);
+    free(filter);
+    return 0;
+}
+
+struct fft_plan *create_fft_plan(size_t points) {
+    if (points == 0) {
+        return NULL;
+    }
+    size_t factors[FFT_MAX_FACTORS];
+    size_t factors_num = 0;
+    int bluestein = (factorize_(points, factors, &factors_num) != 0);
+    size_t twiddles_num = bluestein ? 0 : points;
+    struct fft_plan *plan = malloc(sizeof(*plan) + twiddles_num * sizeof(double complex));
+    if (plan == NULL) {
+        return NULL;
+    }
+    plan->points = points;
+    plan->factors_num = bluestein ? 0 : factors_num;
+    memcpy(plan->factors, factors, plan->factors_num * sizeof(size_t));
+    plan->chirp_plan = NULL;
+    plan->chirp = NULL;
+    plan->chirp_spectrum = NULL;
+    for (size_t k = 0; k < twiddles_num; ++k) {
+        double angle = 2.0 * M_PI * (double)k / (double)points;
+        plan->twiddles[k] = CMPLX(cos(angle), -sin(angle));
+    }
+    if (bluestein) {
+        if (create_chirp_(plan) != 0) {
+            destroy_fft_plan(plan);
+            return NULL;
+        }
+    }
+    return plan;
+}
+
+void destroy_fft_plan(struct fft_plan *plan) {
+    if (plan == NULL) {
+        return;
+    }
+    destroy_fft_plan(plan->chirp_plan);
+    free(plan->chirp);
+    free(plan->chirp_spectrum);
+    free(plan);
+    return;
+}
+
+size_t get_fft_points(const struct fft_plan *plan) {
+    if (plan == NULL) {
+        return 0;
+    }
+    return plan->points;
+}
+
+static int transform_dispatch_(const struct fft_plan *plan, const double complex *in, double complex *out, int backward) {
+    if (plan == NULL) {
+        return -1;
+    }
+    if ((in == NULL) || (out == NULL)) {
+        return -1;
+    }
+    if (plan->chirp_plan != NULL) {
+        return bluestein_(plan, in, out, backward);
+    }
+    if (plan->factors_num == 0) {
+        out[0] = in[0];
+        return 0;
+    }
+    transform_(plan, out, in, plan->points, 1, plan->factors, backward);
+    return 0;
+}
+
+int fft_forward(const struct fft_plan *plan, const double complex *in, double complex *out) {
+    return transform_dispatch_(plan, in, out, 0);
+}
+
+int fft_backward(const struct fft_plan *plan, const double complex *in, double complex *out) {
+    return transform_dispatch_(plan, in, out, 1);
+}
+
+struct real_fft_plan *create_real_fft_plan(size_t points) {
+    if (points == 0) {
+        return NULL;
+    }
+    size_t half = ((points % 2) == 0) ? points / 2 : 0;
+    struct real_fft_plan *plan = malloc(sizeof(*plan) + half * sizeof(double complex));
+    if (plan == NULL) {
+        return NULL;
+    }
+    plan->points = points;
+    plan->plan = create_fft_plan((half > 0) ? half : points);
+    if (plan->plan == NULL) {
+        free(plan);
+        return NULL;
+    }
+    for (size_t k = 0; k < half; ++k) {
+        double angle = 2.0 * M_PI * (double)k / (double)points;
+        plan->twiddles[k] = CMPLX(cos(angle), -sin(angle));
+    }
+    return plan;
+}
+
+void destroy_real_fft_plan(struct real_fft_plan *plan) {
+    if (plan == NULL) {
+        return;
+    }
+    destroy_fft_plan(plan->plan);
+    free(plan);
+    return;
+}
+
+size_t get_real_fft_points(const struct real_fft_plan *plan) {
+    if (plan == NULL) {
+        return 0;
+    }
+    return plan->points;
+}
+
+int real_fft_forward(const struct real_fft_plan *plan, const double *in, double complex *out) {
+    if (plan == NULL) {
+        return -1;
+    }
+    if ((in == NULL) || (out == NULL)) {
+        return -1;
+    }
+    size_t points = plan->points;
+    if ((points % 2) != 0) {
+        double complex *work = malloc(2 * points * sizeof(*work));
+        if (work == NULL) {
+            return -1;
+        }
+        for (size_t n = 0; n < points; ++n) {
+            work[n] = in[n];
+        }
+        int r = fft_forward(plan->plan, work, work + points);
+        memcpy(out, work + points, (points / 2 + 1) * sizeof(*out));
+        free(work);
+        return r;
+    }
+    /* Pack even and odd samples as one complex sequence of half length, then split the spectrum */
+    size_t half = points / 2;
+    double complex *work = malloc(2 * half * sizeof(*work));
+    if (work == NULL) {
+        return -1;
+    }
+    double complex *z = work;
+    double complex *spectrum = work + half;
+    for (size_t m = 0; m < half; ++m) {
+        z[m] = CMPLX(in[2 * m], in[2 * m + 1]);
+    }
+    int r = fft_forward(plan->plan, z, spectrum);
+    for (size_t k = 0; k <= half; ++k) {
+        double complex zk = spectrum[k % half];
+        double complex zc = conj(spectrum[(half - k) % half]);
+        double complex even = (zk + zc) * 0.5;
+        double complex odd = cmul_(zk - zc, CMPLX(0.0, -0.5));
+        double complex w = (k < half) ? plan->twiddles[k] : -1.0;
+        out[k] = even + cmul_(w, odd);
+    }
+    free(work);
+    return r;
+}
@@ -0,0 +1,32 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <stddef.h>
+#include <complex.h>
+
+struct fft_plan;
+
+struct real_fft_plan;
+
+struct fft_plan *create_fft_plan(size_t points);
+
+void destroy_fft_plan(struct fft_plan *plan);
+
+size_t get_fft_points(const struct fft_plan *plan);
+
+/* out[k] = sum(in[n] * exp(-2iπkn/points)), in and out must not overlap */
+int fft_forward(const struct fft_plan *plan, const double complex *in, double complex *out);
+
+/* out[n] = sum(in[k] * exp(2iπkn/points)), not normalised */
+int fft_backward(const struct fft_plan *plan, const double complex *in, double complex *out);
+
+struct real_fft_plan *create_real_fft_plan(size_t points);
+
+void destroy_real_fft_plan(struct real_fft_plan *plan);
+
+size_t get_real_fft_points(const struct real_fft_plan *plan);
+
+/* Same as fft_forward on a real sequence, out holds the points / 2 + 1 first terms */
+int real_fft_forward(const struct real_fft_plan *plan, const double *in, double complex *out);
+
+#endif
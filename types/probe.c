@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "probe.h"
+
+/* Beyond this, measures are only added to the totals */
+#define PROBE_MAX_RECORDS (UINT32_C(1) << 20)
+
+static const char *stage_names_[PROBE_STAGES] = {
+    "load",
+    "get_points_list",
+    "cycle",
+    "split_points_list",
+    "homothetie",
+    "analysis",
+    "reconstruction",
+    "rasterisation",
+    "write",
+};
+
+static const char *counter_names_[PROBE_COUNTERS] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+};
+
+static const uint64_t counter_configs_[PROBE_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+struct record {
+    int stage;
+    long index;
+    size_t items;
+    int64_t wall_ns;
+    int64_t cpu_ns;
+    uint64_t counters[PROBE_COUNTERS];
+    _Bool counted;
+};
+
+struct total {
+    size_t calls;
+    size_t counted;
+    size_t items;
+    int64_t wall_ns;
+    int64_t cpu_ns;
+    uint64_t counters[PROBE_COUNTERS];
+};
+
+/* Counters of one thread, closed when it exits; fds[0] is -1 when they could not be opened */
+struct counters {
+    int fds[PROBE_COUNTERS];
+};
+
+static _Bool quiet_;
+static _Bool enabled_;
+static _Bool hardware_;
+static _Bool warned_;
+static struct timespec started_;
+static size_t started_heap_;
+static pthread_once_t key_once_ = PTHREAD_ONCE_INIT;
+static pthread_key_t counters_key_;
+static __thread struct counters *counters_;
+static pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER;
+static struct record *records_;
+static size_t records_num_;
+static size_t records_allocated_;
+static size_t dropped_;
+static struct total totals_[PROBE_STAGES];
+
+static void close_counters_(void *arg) {
+    struct counters *c = arg;
+    for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+        if (c->fds[i] != -1) {
+            close(c->fds[i]);
+        }
+    }
+    free(c);
+    return;
+}
+
+static void create_key_(void) {
+    (void)pthread_key_create(&counters_key_, close_counters_);
+    return;
+}
+
+static int open_counter_(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    /* Calling thread, on any CPU, counting from now on */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static struct counters *thread_counters_(void) {
+    if (counters_ != NULL) {
+        return counters_;
+    }
+    struct counters *c = malloc(sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    int err = 0;
+    for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+        c->fds[i] = (err == 0) ? open_counter_(counter_configs_[i], (i == 0) ? -1 : c->fds[0]) : -1;
+        if ((c->fds[i] == -1) && (err == 0)) {
+            err = errno;
+        }
+    }
+    if (err != 0) {
+        for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+            if (c->fds[i] != -1) {
+                close(c->fds[i]);
+                c->fds[i] = -1;
+            }
+        }
+        pthread_mutex_lock(&lock_);
+        if (!warned_) {
+            dprintf(2, "Hardware counters are not available (%s)\n", strerror(err));
+            warned_ = 1;
+        }
+        pthread_mutex_unlock(&lock_);
+    }
+    (void)pthread_setspecific(counters_key_, c);
+    counters_ = c;
+    return c;
+}
+
+static int read_counters_(uint64_t *values) {
+    struct counters *c = thread_counters_();
+    if ((c == NULL) || (c->fds[0] == -1)) {
+        return -1;
+    }
+    /* Number of events, then their values */
+    uint64_t group[1 + PROBE_COUNTERS];
+    if ((read(c->fds[0], group, sizeof(group)) != (ssize_t)sizeof(group)) || (group[0] != PROBE_COUNTERS)) {
+        return -1;
+    }
+    memcpy(values, group + 1, sizeof(uint64_t) * PROBE_COUNTERS);
+    return 0;
+}
+
+/* Heap of the whole process, all threads included; mallinfo2 walks every arena under its lock, so it is only taken at the start and the end of the run */
+static size_t heap_in_use_(void) {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static int64_t ns_since_(const struct timespec *start, const struct timespec *now) {
+    return (int64_t)(now->tv_sec - start->tv_sec) * 1000000000 + (now->tv_nsec - start->tv_nsec);
+}
+
+void enable_probes(_Bool hardware) {
+    (void)pthread_once(&key_once_, create_key_);
+    clock_gettime(CLOCK_MONOTONIC, &started_);
+    started_heap_ = heap_in_use_();
+    hardware_ = hardware;
+    enabled_ = 1;
+    return;
+}
+
+void set_quiet(_Bool quiet) {
+    quiet_ = quiet;
+    return;
+}
+
+void note(const char *format, ...) {
+    if (quiet_) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, format);
+    vdprintf(2, format, ap);
+    va_end(ap);
+    return;
+}
+
+void probe_begin(struct probe *p, int stage, long index) {
+    p->on = enabled_ && (stage >= 0) && (stage < PROBE_STAGES);
+    if (!p->on) {
+        return;
+    }
+    p->stage = stage;
+    p->index = index;
+    p->counted = hardware_ && (read_counters_(p->counters) == 0);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &p->cpu);
+    clock_gettime(CLOCK_MONOTONIC, &p->wall);
+    return;
+}
+
+void probe_end(struct probe *p, size_t items) {
+    if (!p->on) {
+        return;
+    }
+    struct timespec wall;
+    struct timespec cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    struct record rec = {
+        .stage = p->stage,
+        .index = p->index,
+        .items = items,
+        .wall_ns = ns_since_(&p->wall, &wall),
+        .cpu_ns = ns_since_(&p->cpu, &cpu),
+    };
+    uint64_t counters[PROBE_COUNTERS];
+    if (p->counted && (read_counters_(counters) == 0)) {
+        rec.counted = 1;
+        for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+            rec.counters[i] = counters[i] - p->counters[i];
+        }
+    }
+    pthread_mutex_lock(&lock_);
+    struct total *t = &totals_[rec.stage];
+    ++t->calls;
+    t->items += rec.items;
+    t->wall_ns += rec.wall_ns;
+    t->cpu_ns += rec.cpu_ns;
+    if (rec.counted) {
+        ++t->counted;
+        for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+            t->counters[i] += rec.counters[i];
+        }
+    }
+    if ((records_num_ == records_allocated_) && (records_allocated_ < PROBE_MAX_RECORDS)) {
+        size_t allocated = (records_allocated_ > 0) ? 2 * records_allocated_ : 256;
+        struct record *records = realloc(records_, allocated * sizeof(*records));
+        if (records != NULL) {
+            records_ = records;
+            records_allocated_ = allocated;
+        }
+    }
+    if (records_num_ < records_allocated_) {
+        records_[records_num_] = rec;
+        ++records_num_;
+    } else {
+        ++dropped_;
+    }
+    pthread_mutex_unlock(&lock_);
+    return;
+}
+
+static void json_counters_(FILE *f, _Bool counted, const uint64_t *counters) {
+    for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+        if (counted) {
+            fprintf(f, ", \"%s\": %" PRIu64, counter_names_[i], counters[i]);
+        } else {
+            fprintf(f, ", \"%s\": null", counter_names_[i]);
+        }
+    }
+    return;
+}
+
+static void csv_counters_(FILE *f, _Bool counted, const uint64_t *counters) {
+    for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+        if (counted) {
+            fprintf(f, ",%" PRIu64, counters[i]);
+        } else {
+            fprintf(f, ",");
+        }
+    }
+    fprintf(f, "\n");
+    return;
+}
+
+static double items_per_second_(const struct total *t) {
+    return (t->wall_ns > 0) ? 1e9 * (double)t->items / (double)t->wall_ns : 0.0;
+}
+
+static void write_json_(FILE *f, double wall_seconds, double cpu_seconds, long peak_rss_kb, int64_t heap_bytes) {
+    _Bool counted = 0;
+    for (int s = 0; s < PROBE_STAGES; ++s) {
+        counted = counted || (totals_[s].counted > 0);
+    }
+    fprintf(f, "{\n  \"wall_seconds\": %.9f,\n  \"cpu_seconds\": %.9f,\n  \"peak_rss_kb\": %ld,\n  \"heap_bytes\": %" PRId64 ",\n", wall_seconds, cpu_seconds, peak_rss_kb, heap_bytes);
+    fprintf(f, "  \"hardware_counters\": %s,\n  \"dropped_records\": %zu,\n  \"stages\": [", counted ? "true" : "false", dropped_);
+    for (int s = 0; s < PROBE_STAGES; ++s) {
+        const struct total *t = &totals_[s];
+        fprintf(f, "%s\n    {\"stage\": \"%s\", \"calls\": %zu, \"items\": %zu, \"wall_seconds\": %.9f, \"cpu_seconds\": %.9f, \"items_per_second\": %.3f",
+                (s > 0) ? "," : "", stage_names_[s], t->calls, t->items, 1e-9 * (double)t->wall_ns, 1e-9 * (double)t->cpu_ns, items_per_second_(t));
+        json_counters_(f, (t->calls > 0) && (t->counted == t->calls), t->counters);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ],\n  \"records\": [");
+    for (size_t i = 0; i < records_num_; ++i) {
+        const struct record *r = &records_[i];
+        fprintf(f, "%s\n    {\"stage\": \"%s\", ", (i > 0) ? "," : "", stage_names_[r->stage]);
+        if (r->index >= 0) {
+            fprintf(f, "\"index\": %ld", r->index);
+        } else {
+            fprintf(f, "\"index\": null");
+        }
+        fprintf(f, ", \"items\": %zu, \"wall_seconds\": %.9f, \"cpu_seconds\": %.9f", r->items, 1e-9 * (double)r->wall_ns, 1e-9 * (double)r->cpu_ns);
+        json_counters_(f, r->counted, r->counters);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return;
+}
+
+/* Totals come after the records, with an empty index and the whole run on a last line, the only one with a heap growth */
+static void write_csv_(FILE *f, double wall_seconds, double cpu_seconds, int64_t heap_bytes) {
+    fprintf(f, "kind,stage,index,calls,items,wall_seconds,cpu_seconds,heap_bytes,items_per_second");
+    for (size_t i = 0; i < PROBE_COUNTERS; ++i) {
+        fprintf(f, ",%s", counter_names_[i]);
+    }
+    fprintf(f, "\n");
+    for (size_t i = 0; i < records_num_; ++i) {
+        const struct record *r = &records_[i];
+        fprintf(f, "record,%s,", stage_names_[r->stage]);
+        if (r->index >= 0) {
+            fprintf(f, "%ld", r->index);
+        }
+        fprintf(f, ",1,%zu,%.9f,%.9f,,", r->items, 1e-9 * (double)r->wall_ns, 1e-9 * (double)r->cpu_ns);
+        csv_counters_(f, r->counted, r->counters);
+    }
+    for (int s = 0; s < PROBE_STAGES; ++s) {
+        const struct total *t = &totals_[s];
+        fprintf(f, "total,%s,,%zu,%zu,%.9f,%.9f,,%.3f", stage_names_[s], t->calls, t->items, 1e-9 * (double)t->wall_ns, 1e-9 * (double)t->cpu_ns, items_per_second_(t));
+        csv_counters_(f, (t->calls > 0) && (t->counted == t->calls), t->counters);
+    }
+    fprintf(f, "run,all,,,,%.9f,%.9f,%" PRId64 ",", wall_seconds, cpu_seconds, heap_bytes);
+    csv_counters_(f, 0, NULL);
+    return;
+}
+
+int write_probe_report(const char *fname) {
+    struct timespec now;
+    struct timespec cpu;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    struct rusage ru;
+    long peak_rss_kb = (getrusage(RUSAGE_SELF, &ru) == 0) ? ru.ru_maxrss : -1;
+    int64_t heap_bytes = (int64_t)heap_in_use_() - (int64_t)started_heap_;
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+        dprintf(2, "Cannot open the report %s (%s)\n", fname, strerror(errno));
+        return -1;
+    }
+    size_t len = strlen(fname);
+    pthread_mutex_lock(&lock_);
+    double wall_seconds = 1e-9 * (double)ns_since_(&started_, &now);
+    double cpu_seconds = (double)cpu.tv_sec + 1e-9 * (double)cpu.tv_nsec;
+    if ((len >= 4) && (strcmp(fname + len - 4, ".csv") == 0)) {
+        write_csv_(f, wall_seconds, cpu_seconds, heap_bytes);
+    } else {
+        write_json_(f, wall_seconds, cpu_seconds, peak_rss_kb, heap_bytes);
+    }
+    pthread_mutex_unlock(&lock_);
+    int err = ferror(f);
+    if ((fclose(f) != 0) || (err != 0)) {
+        dprintf(2, "Cannot write the report %s\n", fname);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef PROBE_H_
+#define PROBE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define PROBE_LOAD 0
+#define PROBE_EXTRACT 1
+#define PROBE_CYCLE 2
+#define PROBE_SPLIT 3
+#define PROBE_HOMOTHETIE 4
+#define PROBE_ANALYSIS 5
+#define PROBE_RECONSTRUCT 6
+#define PROBE_RASTERISE 7
+#define PROBE_WRITE 8
+#define PROBE_STAGES 9
+
+#define PROBE_COUNTERS 3
+
+/* One measure of a stage, on the stack of the thread running it */
+struct probe {
+    int stage;
+    long index;
+    struct timespec wall;
+    struct timespec cpu;
+    uint64_t counters[PROBE_COUNTERS];
+    _Bool on;
+    _Bool counted;
+};
+
+/* Starts recording the stages, with the CPU cycles, instructions and cache misses when hardware is set */
+void enable_probes(_Bool hardware);
+
+/* Progress messages are left out once quiet, errors are still printed with dprintf */
+void set_quiet(_Bool quiet);
+
+void note(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* index is the picture of the frame stages, -1 for the others; nothing is done unless enabled */
+void probe_begin(struct probe *p, int stage, long index);
+
+/* Records the stage begun by p, which processed items (points, modes, samples or pixels) */
+void probe_end(struct probe *p, size_t items);
+
+/* Writes every measure and the totals of each stage, as CSV if fname ends with .csv, as JSON otherwise */
+int write_probe_report(const char *fname);
+
+#endif